@@ -0,0 +1,22 @@
+#pragma once
+
+#include "MaterialTypes.h"
+
+class UMaterialInstanceDynamic;
+class FMaterialInstanceResource;
+
+/* TinyRenderer が所有する MID へのパラメータ変更。Render() の描画コマンドでまとめて RenderThread に反映する */
+struct FTRMaterialParameterUpdate
+{
+	TWeakObjectPtr<UMaterialInstanceDynamic> MaterialInstance;
+	FName ParameterName;
+	FMaterialParameterValue Value;
+};
+
+/* RenderThread に渡すパラメータ変更。FMaterialInstanceResource は MID が生きている間は有効 */
+struct FTRMaterialParameterRenderUpdate
+{
+	FMaterialInstanceResource* Resource;
+	FHashedMaterialParameterInfo ParameterInfo;
+	FMaterialParameterValue Value;
+};
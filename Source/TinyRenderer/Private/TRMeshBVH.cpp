@@ -0,0 +1,226 @@
+#include "TRMeshBVH.h"
+
+#include "StaticMeshResources.h"
+
+/* 葉ノードに格納する三角形の最大数 */
+static constexpr uint32 TRMeshBVHMaxLeafTriangles = 4;
+
+bool FTRMeshBVHSourceData::CopyFrom(const FStaticMeshLODResources& LODResource)
+{
+	const FPositionVertexBuffer& PositionVertexBuffer = LODResource.VertexBuffers.PositionVertexBuffer;
+	// Cook 済みのビルドでは、Allow CPU Access が無効なメッシュの頂点データは CPU 側に残らない
+	if (!PositionVertexBuffer.GetVertexData() || PositionVertexBuffer.GetNumVertices() == 0)
+	{
+		return false;
+	}
+
+	LODResource.IndexBuffer.GetCopy(Indices);
+	if (Indices.Num() != LODResource.IndexBuffer.GetNumIndices() || Indices.IsEmpty())
+	{
+		return false;
+	}
+
+	Positions.SetNumUninitialized(PositionVertexBuffer.GetNumVertices());
+	for (uint32 VertexIndex = 0; VertexIndex < PositionVertexBuffer.GetNumVertices(); VertexIndex++)
+	{
+		Positions[VertexIndex] = PositionVertexBuffer.VertexPosition(VertexIndex);
+	}
+
+	// セクションは IndexBuffer 上の連続した範囲なので、三角形ごとにセクション番号を割り当てる
+	TriangleSections.SetNumZeroed(Indices.Num() / 3);
+	SectionMaterialIndices.Reset(LODResource.Sections.Num());
+	for (int32 SectionIndex = 0; SectionIndex < LODResource.Sections.Num(); SectionIndex++)
+	{
+		const FStaticMeshSection& Section = LODResource.Sections[SectionIndex];
+		SectionMaterialIndices.Add(Section.MaterialIndex);
+
+		const uint32 FirstTriangle = Section.FirstIndex / 3;
+		for (uint32 TriangleIndex = FirstTriangle; TriangleIndex < FirstTriangle + Section.NumTriangles; TriangleIndex++)
+		{
+			TriangleSections[TriangleIndex] = static_cast<uint16>(SectionIndex);
+		}
+	}
+	return true;
+}
+
+FTRMeshBVH::FTRMeshBVH(FTRMeshBVHSourceData&& SourceData)
+{
+	SCOPED_NAMED_EVENT(FTRMeshBVH_Build, FColor::Emerald);
+
+	SectionMaterialIndices = MoveTemp(SourceData.SectionMaterialIndices);
+
+	const int32 NumTriangles = SourceData.Indices.Num() / 3;
+	Triangles.Reserve(NumTriangles);
+	TArray<FVector3f> Centroids;
+	Centroids.Reserve(NumTriangles);
+	for (int32 TriangleIndex = 0; TriangleIndex < NumTriangles; TriangleIndex++)
+	{
+		const FVector3f& V0 = SourceData.Positions[SourceData.Indices[TriangleIndex * 3 + 0]];
+		const FVector3f& V1 = SourceData.Positions[SourceData.Indices[TriangleIndex * 3 + 1]];
+		const FVector3f& V2 = SourceData.Positions[SourceData.Indices[TriangleIndex * 3 + 2]];
+		Triangles.Add(FTriangle{V0, V1 - V0, V2 - V0, SourceData.TriangleSections[TriangleIndex]});
+		Centroids.Add((V0 + V1 + V2) / 3.0f);
+	}
+
+	if (Triangles.IsEmpty())
+	{
+		return;
+	}
+
+	// 完全二分木として必要なノード数を上限として確保しておく
+	Nodes.Reserve(FMath::Max(1, NumTriangles * 2 - 1));
+	Nodes.Add(FNode{FVector3f::ZeroVector, 0, FVector3f::ZeroVector, static_cast<uint32>(NumTriangles)});
+	BuildRecursive(0, Centroids);
+	Nodes.Shrink();
+}
+
+void FTRMeshBVH::BuildRecursive(const uint32 NodeIndex, TArray<FVector3f>& Centroids)
+{
+	const uint32 First = Nodes[NodeIndex].LeftOrFirst;
+	const uint32 Count = Nodes[NodeIndex].Count;
+
+	// ノードの AABB と、三角形の重心の AABB を計算
+	FBox3f Bounds(ForceInit);
+	FBox3f CentroidBounds(ForceInit);
+	for (uint32 TriangleIndex = First; TriangleIndex < First + Count; TriangleIndex++)
+	{
+		const FTriangle& Triangle = Triangles[TriangleIndex];
+		Bounds += Triangle.V0;
+		Bounds += Triangle.V0 + Triangle.Edge1;
+		Bounds += Triangle.V0 + Triangle.Edge2;
+		CentroidBounds += Centroids[TriangleIndex];
+	}
+	Nodes[NodeIndex].Min = Bounds.Min;
+	Nodes[NodeIndex].Max = Bounds.Max;
+
+	if (Count <= TRMeshBVHMaxLeafTriangles)
+	{
+		return;
+	}
+
+	// 重心の広がりが最も大きい軸の中点で分割する
+	const FVector3f Extent = CentroidBounds.GetExtent();
+	const int32 Axis = Extent.X >= Extent.Y && Extent.X >= Extent.Z ? 0 : (Extent.Y >= Extent.Z ? 1 : 2);
+	const float SplitPosition = CentroidBounds.GetCenter()[Axis];
+
+	uint32 Mid = First;
+	for (uint32 TriangleIndex = First; TriangleIndex < First + Count; TriangleIndex++)
+	{
+		if (Centroids[TriangleIndex][Axis] < SplitPosition)
+		{
+			Swap(Triangles[TriangleIndex], Triangles[Mid]);
+			Swap(Centroids[TriangleIndex], Centroids[Mid]);
+			Mid++;
+		}
+	}
+	// 重心が一点に集まっていて分割できない場合は、数で半分に分ける
+	if (Mid == First || Mid == First + Count)
+	{
+		Mid = First + Count / 2;
+	}
+
+	const uint32 LeftIndex = Nodes.Num();
+	Nodes.Add(FNode{FVector3f::ZeroVector, First, FVector3f::ZeroVector, Mid - First});
+	Nodes.Add(FNode{FVector3f::ZeroVector, Mid, FVector3f::ZeroVector, First + Count - Mid});
+	Nodes[NodeIndex].LeftOrFirst = LeftIndex;
+	Nodes[NodeIndex].Count = 0;
+
+	BuildRecursive(LeftIndex, Centroids);
+	BuildRecursive(LeftIndex + 1, Centroids);
+}
+
+/* スラブ法によるレイと AABB の交差判定。交差する場合はレイ上の入射距離を返す */
+static bool IntersectRayBox(const FVector3f& Origin, const FVector3f& InvDirection, const FVector3f& Min,
+                            const FVector3f& Max, const float MaxDistance, float& OutDistance)
+{
+	const FVector3f T0 = (Min - Origin) * InvDirection;
+	const FVector3f T1 = (Max - Origin) * InvDirection;
+	const float TNear = FMath::Max3(FMath::Min(T0.X, T1.X), FMath::Min(T0.Y, T1.Y), FMath::Min(T0.Z, T1.Z));
+	const float TFar = FMath::Min3(FMath::Max(T0.X, T1.X), FMath::Max(T0.Y, T1.Y), FMath::Max(T0.Z, T1.Z));
+	OutDistance = TNear;
+	return TNear <= TFar && TFar >= 0.0f && TNear < MaxDistance;
+}
+
+bool FTRMeshBVH::Raycast(const FVector3f& Origin, const FVector3f& Direction, FTRMeshBVHHit& OutHit) const
+{
+	if (Nodes.IsEmpty())
+	{
+		return false;
+	}
+
+	const FVector3f InvDirection(1.0f / Direction.X, 1.0f / Direction.Y, 1.0f / Direction.Z);
+	float ClosestDistance = TNumericLimits<float>::Max();
+	uint32 ClosestTriangle = MAX_uint32;
+
+	// 近い子ノードから探索し、より近い交差が見つかっている場合は枝刈りする
+	TArray<uint32, TInlineAllocator<64>> NodeStack;
+	NodeStack.Push(0);
+	while (!NodeStack.IsEmpty())
+	{
+		const FNode& Node = Nodes[NodeStack.Pop(false)];
+		float BoxDistance;
+		if (!IntersectRayBox(Origin, InvDirection, Node.Min, Node.Max, ClosestDistance, BoxDistance))
+		{
+			continue;
+		}
+
+		if (Node.Count == 0)
+		{
+			const FNode& Left = Nodes[Node.LeftOrFirst];
+			const FNode& Right = Nodes[Node.LeftOrFirst + 1];
+			const bool bLeftFirst = ((Left.Min + Left.Max - Right.Min - Right.Max) | Direction) <= 0.0f;
+			NodeStack.Push(bLeftFirst ? Node.LeftOrFirst + 1 : Node.LeftOrFirst);
+			NodeStack.Push(bLeftFirst ? Node.LeftOrFirst : Node.LeftOrFirst + 1);
+			continue;
+		}
+
+		// Möller–Trumbore 法によるレイと三角形の交差判定。裏面も交差として扱う
+		for (uint32 TriangleIndex = Node.LeftOrFirst; TriangleIndex < Node.LeftOrFirst + Node.Count; TriangleIndex++)
+		{
+			const FTriangle& Triangle = Triangles[TriangleIndex];
+			const FVector3f P = Direction ^ Triangle.Edge2;
+			const float Determinant = Triangle.Edge1 | P;
+			if (FMath::Abs(Determinant) < UE_SMALL_NUMBER)
+			{
+				continue;
+			}
+			const float InvDeterminant = 1.0f / Determinant;
+			const FVector3f T = Origin - Triangle.V0;
+			const float U = (T | P) * InvDeterminant;
+			if (U < 0.0f || U > 1.0f)
+			{
+				continue;
+			}
+			const FVector3f Q = T ^ Triangle.Edge1;
+			const float V = (Direction | Q) * InvDeterminant;
+			if (V < 0.0f || U + V > 1.0f)
+			{
+				continue;
+			}
+			const float Distance = (Triangle.Edge2 | Q) * InvDeterminant;
+			if (Distance >= 0.0f && Distance < ClosestDistance)
+			{
+				ClosestDistance = Distance;
+				ClosestTriangle = TriangleIndex;
+			}
+		}
+	}
+
+	if (ClosestTriangle == MAX_uint32)
+	{
+		return false;
+	}
+
+	const uint32 SectionIndex = Triangles[ClosestTriangle].SectionIndex;
+	OutHit.SectionIndex = SectionIndex;
+	OutHit.MaterialIndex = SectionMaterialIndices.IsValidIndex(SectionIndex)
+		                       ? SectionMaterialIndices[SectionIndex]
+		                       : INDEX_NONE;
+	OutHit.Distance = ClosestDistance;
+	return true;
+}
+
+SIZE_T FTRMeshBVH::GetAllocatedSize() const
+{
+	return Nodes.GetAllocatedSize() + Triangles.GetAllocatedSize() + SectionMaterialIndices.GetAllocatedSize();
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+struct FStaticMeshLODResources;
+
+/* BVH の構築に必要なメッシュデータ。GameThread で LODResources からコピーし、ワーカースレッドで BVH を構築する */
+struct FTRMeshBVHSourceData
+{
+	TArray<FVector3f> Positions;
+	TArray<uint32> Indices;
+	/* 三角形ごとのセクション番号 */
+	TArray<uint16> TriangleSections;
+	/* セクションごとのマテリアル番号 */
+	TArray<int32> SectionMaterialIndices;
+
+	/* LODResources から CPU 側のデータを読み出す。CPU アクセスできない場合は false */
+	bool CopyFrom(const FStaticMeshLODResources& LODResource);
+};
+
+struct FTRMeshBVHHit
+{
+	int32 SectionIndex = INDEX_NONE;
+	int32 MaterialIndex = INDEX_NONE;
+	/* レイ上の距離。レイの方向ベクトルの長さを 1 とした値 */
+	float Distance = TNumericLimits<float>::Max();
+};
+
+/* StaticMesh の三角形に対するレイキャスト用の BVH。ローカル空間で構築・探索を行う */
+class FTRMeshBVH
+{
+public:
+	explicit FTRMeshBVH(FTRMeshBVHSourceData&& SourceData);
+
+	/* ローカル空間のレイと最も近い三角形の交差を求める */
+	bool Raycast(const FVector3f& Origin, const FVector3f& Direction, FTRMeshBVHHit& OutHit) const;
+
+	SIZE_T GetAllocatedSize() const;
+
+private:
+	/* 32 byte のノード。Count が 0 なら内部ノードで、LeftOrFirst は左の子ノードを指す (右の子は直後)。
+	   0 より大きい場合は葉ノードで、LeftOrFirst は Triangles の先頭を指す */
+	struct FNode
+	{
+		FVector3f Min;
+		uint32 LeftOrFirst;
+		FVector3f Max;
+		uint32 Count;
+	};
+
+	struct FTriangle
+	{
+		FVector3f V0;
+		FVector3f Edge1;
+		FVector3f Edge2;
+		uint32 SectionIndex;
+	};
+
+	void BuildRecursive(uint32 NodeIndex, TArray<FVector3f>& Centroids);
+
+	TArray<FNode> Nodes;
+	TArray<FTriangle> Triangles;
+	TArray<int32> SectionMaterialIndices;
+};
@@ -1,9 +1,12 @@
 #include "TinyRenderer.h"
 
+#include "GlobalShader.h"
 #include "MeshMaterialShader.h"
 #include "MeshPassProcessor.h"
 #include "MeshPassProcessor.inl"
 #include "RenderGraphBuilder.h"
+#include "RenderGraphUtils.h"
+#include "ScreenPass.h"
 #include "SimpleMeshDrawCommandPass.h"
 #include "Materials/MaterialRenderProxy.h"
 #include "ShaderParameterStruct.h"
@@ -94,6 +97,40 @@ IMPLEMENT_MATERIAL_SHADER_TYPE(, FTinyRendererShaderPS,
                                  TEXT("/TinyRenderer/Private/TinyRendererShader.usf"),
                                  TEXT("MainPS"), SF_Pixel);
 
+/* 累積描画で、前回までの履歴に今回のサンプルを加えた平均を新しい履歴テクスチャに書き込むコンピュートシェーダー */
+class FTinyRendererAccumulateCS : public FGlobalShader
+{
+	DECLARE_GLOBAL_SHADER(FTinyRendererAccumulateCS);
+	SHADER_USE_PARAMETER_STRUCT(FTinyRendererAccumulateCS, FGlobalShader);
+
+	BEGIN_SHADER_PARAMETER_STRUCT(FParameters,)
+		SHADER_PARAMETER_RDG_TEXTURE(Texture2D<float4>, SceneColorTexture)
+		SHADER_PARAMETER_RDG_TEXTURE(Texture2D<float4>, HistoryTexture)
+		SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture2D<float4>, OutputTexture)
+		SHADER_PARAMETER(FIntPoint, TextureSize)
+		SHADER_PARAMETER(float, BlendWeight)
+		SHADER_PARAMETER(uint32, bFirstSample)
+	END_SHADER_PARAMETER_STRUCT()
+
+public:
+	static constexpr int32 ThreadGroupSize = 8;
+
+	static void ModifyCompilationEnvironment(const FGlobalShaderPermutationParameters& Parameters,
+	                                         FShaderCompilerEnvironment& OutEnvironment)
+	{
+		FGlobalShader::ModifyCompilationEnvironment(Parameters, OutEnvironment);
+		OutEnvironment.SetDefine(TEXT("THREADGROUP_SIZE"), ThreadGroupSize);
+	}
+
+	static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters)
+	{
+		return true;
+	}
+};
+
+IMPLEMENT_GLOBAL_SHADER(FTinyRendererAccumulateCS, "/TinyRenderer/Private/TinyRendererAccumulation.usf", "MainCS",
+                        SF_Compute);
+
 /* TinyRenderer のシェーダーが利用するパラメータ構造体を定義 */
 BEGIN_SHADER_PARAMETER_STRUCT(FTinyRendererShaderParameters,)
 	SHADER_PARAMETER_STRUCT_REF(FViewUniformShaderParameters, View)
@@ -225,8 +262,8 @@ bool FTinyRenderer::CreateMeshBatch(TArray<FMeshBatch>& OutMeshBatches,
 	// StaticMesh から RenderData を取得。ここに StaticMesh のメッシュデータが格納されている
 	FStaticMeshRenderData* RenderData = StaticMesh->GetRenderData();
 
-	const int32 LODResourceIndex = FMath::Min(LODIndex, RenderData->LODResources.Num() - 1);
-	if (LODResourceIndex < 0)
+	const int32 LODResourceIndex = GetRenderableLODIndex(*RenderData, LODIndex);
+	if (LODResourceIndex == INDEX_NONE)
 	{
 		return false;
 	}
@@ -420,14 +457,115 @@ void FTinyRenderer::SetStaticMeshData(UStaticMesh* InStaticMesh, const int32 InL
 	});
 }
 
-void FTinyRenderer::Render(FRDGBuilder& GraphBuilder)
+/**
+ * @param InStaticMesh 判定対象の StaticMesh
+ * @param InLODIndex 描画する LOD
+ * @return メッシュのコンパイルが完了しており、描画できる LOD が常駐している場合は true
+ */
+bool FTinyRenderer::IsStaticMeshReady(const UStaticMesh* InStaticMesh, const int32 InLODIndex)
+{
+	if (!InStaticMesh || InStaticMesh->IsCompiling())
+	{
+		return false;
+	}
+
+	const FStaticMeshRenderData* RenderData = InStaticMesh->GetRenderData();
+	if (!RenderData || !RenderData->IsInitialized())
+	{
+		return false;
+	}
+	return GetRenderableLODIndex(*RenderData, InLODIndex) != INDEX_NONE;
+}
+
+/**
+ * TinyRenderer はストリーミングの要求を出さないので、指定 LOD が常駐するのを待つと、MinLOD が設定されたメッシュや
+ * LOD が取り除かれたメッシュはいつまでも描画できない。そのため、常駐している最も詳細な LOD で代用する。
+ * 存在しない LOD を指定された場合は最も粗い LOD を使う
+ * @param InRenderData 描画対象の StaticMesh の描画データ
+ * @param InLODIndex 描画する LOD
+ * @return 実際に描画する LOD。常駐している LOD がない場合は INDEX_NONE
+ */
+int32 FTinyRenderer::GetRenderableLODIndex(const FStaticMeshRenderData& InRenderData, const int32 InLODIndex)
+{
+	const int32 FirstResidentLODIndex = InRenderData.GetCurrentFirstLODIdx(0);
+	const int32 LastLODIndex = InRenderData.LODResources.Num() - 1;
+	if (FirstResidentLODIndex > LastLODIndex)
+	{
+		return INDEX_NONE;
+	}
+	return FMath::Clamp(InLODIndex, FirstResidentLODIndex, LastLODIndex);
+}
+
+/**
+ * @param InMaterial 判定対象のマテリアル
+ * @param InFeatureLevel 描画に利用する FeatureLevel
+ * @return シェーダーが揃っているか、コンパイルが終わって Fallback のマテリアルが使われることが確定している場合は true
+ */
+bool FTinyRenderer::AreMaterialShadersReady(UMaterialInterface* InMaterial, const ERHIFeatureLevel::Type InFeatureLevel)
+{
+	const FMaterial* MaterialResource = InMaterial ? InMaterial->GetMaterialResource(InFeatureLevel) : nullptr;
+	if (!MaterialResource)
+	{
+		return false;
+	}
+
+	FMaterialShaderTypes ShaderTypes;
+	ShaderTypes.AddShaderType<FTinyRendererShaderVS>();
+	ShaderTypes.AddShaderType<FTinyRendererShaderPS>();
+	return MaterialResource->HasShaders(ShaderTypes, &FLocalVertexFactory::StaticType) ||
+		MaterialResource->IsCompilationFinished();
+}
+
+/**
+ * @param InTileRect 出力先 RenderTarget 上で、このレンダラが描画を担当する領域
+ * @param InTileTextureSize タイル描画用の SceneColor / SceneDepth のサイズ。InTileRect のサイズ以上である必要がある
+ */
+void FTinyRenderer::SetOutputTile(const FIntRect& InTileRect, const FIntPoint& InTileTextureSize)
+{
+	check(InTileRect.Width() <= InTileTextureSize.X && InTileRect.Height() <= InTileTextureSize.Y);
+	OutputTileRect = InTileRect;
+	TileTextureSize = InTileTextureSize;
+}
+
+/**
+ * @param InAccumulationState フレームをまたいで保持される累積の状態
+ * @param InSampleIndex 今回描画するサンプルの番号
+ */
+void FTinyRenderer::SetAccumulation(FTinyRendererAccumulationState* InAccumulationState, const int32 InSampleIndex)
+{
+	AccumulationState = InAccumulationState;
+	AccumulationSampleIndex = InSampleIndex;
+}
+
+bool FTinyRenderer::Render(FRDGBuilder& GraphBuilder)
 {
 	SCOPED_NAMED_EVENT(FTinyRenderer_Render, FColor::Emerald);
 
+	// 累積をやり直す場合は、このサンプルの描画に失敗しても以前の累積の履歴が使われないよう、先に破棄する
+	if (AccumulationState && AccumulationSampleIndex == 0)
+	{
+		AccumulationState->HistoryTexture.SafeRelease();
+		AccumulationState->NumAccumulatedSamples = 0;
+	}
+
 	// レンダリング対象の SceneTextures を作成
 	const FTinySceneTextures SceneTextures = SetupSceneTextures(GraphBuilder);
 	// BasePass をレンダリング
-	RenderBasePass(GraphBuilder, SceneTextures);
+	if (!RenderBasePass(GraphBuilder, SceneTextures))
+	{
+		return false;
+	}
+	// タイル描画の場合は、描画したタイルを出力先に書き込む
+	if (OutputTileRect.IsSet())
+	{
+		CopyTileToOutput(GraphBuilder, SceneTextures);
+	}
+	// 累積描画の場合は、描画したサンプルを履歴に累積して出力先に書き込む
+	else if (AccumulationState)
+	{
+		AccumulateToOutput(GraphBuilder, SceneTextures);
+	}
+	return true;
 }
 
 FTinyRenderer::FTinySceneTextures FTinyRenderer::SetupSceneTextures(FRDGBuilder& GraphBuilder) const
@@ -438,19 +576,106 @@ FTinyRenderer::FTinySceneTextures FTinyRenderer::SetupSceneTextures(FRDGBuilder&
 	const FRDGTextureRef TinyRendererOutputRef = GraphBuilder.RegisterExternalTexture(
 		CreateRenderTarget(RenderTarget->GetRenderTargetTexture(), TEXT("TinyRendererOutput")));
 
+	// タイル描画の場合は、出力先ではなくタイルサイズの SceneColor に描画し、後から出力先にコピーする
+	// SceneDepth も含めてタイルサイズで固定しておくことで、どのタイルでも同じプール済みテクスチャが再利用される
+	const FIntPoint SceneTextureSize = OutputTileRect.IsSet() ? TileTextureSize : RenderTarget->GetSizeXY();
+
+	FRDGTextureRef SceneColor = TinyRendererOutputRef;
+	if (OutputTileRect.IsSet())
+	{
+		// 出力先にはそのままコピーされるので、sRGB の出力先であればタイルも sRGB で書き込む
+		const FRDGTextureDesc ColorDesc = FRDGTextureDesc::Create2D(SceneTextureSize,
+		                                                            TinyRendererOutputRef->Desc.Format,
+		                                                            TinyRendererOutputRef->Desc.ClearValue,
+		                                                            TexCreate_RenderTargetable |
+		                                                            TexCreate_ShaderResource |
+		                                                            (TinyRendererOutputRef->Desc.Flags &
+			                                                            TexCreate_SRGB));
+		SceneColor = GraphBuilder.CreateTexture(ColorDesc, TEXT("TinyRendererTileColor"));
+	}
+	// 累積描画の場合は、サンプルを精度の高いフォーマットで描画し、履歴と合成してから出力先に書き込む
+	else if (AccumulationState)
+	{
+		const FRDGTextureDesc ColorDesc = FRDGTextureDesc::Create2D(SceneTextureSize, PF_FloatRGBA,
+		                                                            TinyRendererOutputRef->Desc.ClearValue,
+		                                                            TexCreate_RenderTargetable |
+		                                                            TexCreate_ShaderResource);
+		SceneColor = GraphBuilder.CreateTexture(ColorDesc, TEXT("TinyRendererAccumulationSample"));
+	}
+
 	// SceneDepth 用のテクスチャを作成。今回は外部から参照しないので、ここで作成して利用する。
-	const FRDGTextureDesc Desc = FRDGTextureDesc::Create2D(RenderTarget->GetSizeXY(), PF_DepthStencil,
+	const FRDGTextureDesc Desc = FRDGTextureDesc::Create2D(SceneTextureSize, PF_DepthStencil,
 	                                                       FClearValueBinding::DepthFar,
 	                                                       TexCreate_DepthStencilTargetable | TexCreate_ShaderResource);
 	const FRDGTextureRef SceneDepth = GraphBuilder.CreateTexture(Desc, TEXT("SceneDepthZ"));
 
 	return FTinySceneTextures{
-		.SceneColorTexture = TinyRendererOutputRef,
+		.OutputTexture = TinyRendererOutputRef,
+		.SceneColorTexture = SceneColor,
 		.SceneDepthTexture = SceneDepth
 	};
 }
 
-void FTinyRenderer::RenderBasePass(FRDGBuilder& GraphBuilder, const FTinySceneTextures& SceneTextures)
+void FTinyRenderer::CopyTileToOutput(FRDGBuilder& GraphBuilder, const FTinySceneTextures& SceneTextures) const
+{
+	const FIntRect& TileRect = OutputTileRect.GetValue();
+
+	// タイル用テクスチャの左上から、出力先のタイル領域へコピー。端のタイルはタイル用テクスチャより小さいことがある
+	FRHICopyTextureInfo CopyInfo;
+	CopyInfo.Size = FIntVector(TileRect.Width(), TileRect.Height(), 1);
+	CopyInfo.DestPosition = FIntVector(TileRect.Min.X, TileRect.Min.Y, 0);
+	AddCopyTexturePass(GraphBuilder, SceneTextures.SceneColorTexture, SceneTextures.OutputTexture, CopyInfo);
+}
+
+void FTinyRenderer::AccumulateToOutput(FRDGBuilder& GraphBuilder, const FTinySceneTextures& SceneTextures) const
+{
+	const FIntPoint Extent = SceneTextures.SceneColorTexture->Desc.Extent;
+
+	// 前回までの履歴は SRV として読み、今回の結果は新しいテクスチャに書き込む。
+	// 同じテクスチャへの読み書きは、PF_FloatRGBA の UAV からの読み込みに対応していない環境では使えない
+	// GameThread のサンプル番号ではなく、実際に履歴に書き込まれたサンプルの数をもとに判定する
+	const TRefCountPtr<IPooledRenderTarget>& PooledHistory = AccumulationState->HistoryTexture;
+	const int32 NumAccumulatedSamples = AccumulationState->NumAccumulatedSamples;
+	const bool bFirstSample = NumAccumulatedSamples == 0 || !PooledHistory.IsValid() ||
+		PooledHistory->GetDesc().Extent != Extent;
+	const FRDGTextureRef PrevHistoryTexture = bFirstSample
+		                                          ? GSystemTextures.GetBlackDummy(GraphBuilder)
+		                                          : GraphBuilder.RegisterExternalTexture(PooledHistory);
+	const FRDGTextureRef HistoryTexture = GraphBuilder.CreateTexture(
+		FRDGTextureDesc::Create2D(Extent, PF_FloatRGBA, FClearValueBinding::None,
+		                          TexCreate_ShaderResource | TexCreate_UAV),
+		TEXT("TinyRendererAccumulationHistory"));
+
+	// N 枚目のサンプルの重みを 1 / N にすると、履歴は全サンプルの平均になる。
+	// 最初のサンプルは履歴を読まずにそのまま書き込むので、プールから再利用したテクスチャの内容に影響されない
+	FTinyRendererAccumulateCS::FParameters* PassParameters =
+		GraphBuilder.AllocParameters<FTinyRendererAccumulateCS::FParameters>();
+	PassParameters->SceneColorTexture = SceneTextures.SceneColorTexture;
+	PassParameters->HistoryTexture = PrevHistoryTexture;
+	PassParameters->OutputTexture = GraphBuilder.CreateUAV(HistoryTexture);
+	PassParameters->TextureSize = Extent;
+	PassParameters->BlendWeight = bFirstSample ? 1.0f : 1.0f / (NumAccumulatedSamples + 1);
+	PassParameters->bFirstSample = bFirstSample ? 1 : 0;
+	AccumulationState->NumAccumulatedSamples = bFirstSample ? 1 : NumAccumulatedSamples + 1;
+
+	const TShaderMapRef<FTinyRendererAccumulateCS> ComputeShader(GetGlobalShaderMap(FeatureLevel));
+	FComputeShaderUtils::AddPass(GraphBuilder, RDG_EVENT_NAME("TinyRendererAccumulate"), ComputeShader,
+	                             PassParameters,
+	                             FComputeShaderUtils::GetGroupCount(Extent, FTinyRendererAccumulateCS::ThreadGroupSize));
+
+	// 出力先とはフォーマットが異なるので、コピーではなく描画で書き込む
+	const FViewInfo* View = static_cast<const FViewInfo*>(ViewFamily.Views[0]);
+	AddDrawTexturePass(GraphBuilder, *View, HistoryTexture, SceneTextures.OutputTexture);
+
+	GraphBuilder.QueueTextureExtraction(HistoryTexture, &AccumulationState->HistoryTexture);
+}
+
+/**
+ * @param GraphBuilder RDGBuilder
+ * @param SceneTextures 描画先の SceneTextures
+ * @return BasePass の描画が登録された場合は true、それ以外は false
+ */
+bool FTinyRenderer::RenderBasePass(FRDGBuilder& GraphBuilder, const FTinySceneTextures& SceneTextures)
 {
 	SCOPED_NAMED_EVENT(FTinyRenderer_RenderBasePass, FColor::Emerald);
 
@@ -459,7 +684,7 @@ void FTinyRenderer::RenderBasePass(FRDGBuilder& GraphBuilder, const FTinySceneTe
 	if (!Mesh)
 	{
 		UE_LOG(LogTinyRenderer, Warning, TEXT("StaticMesh is not valid"));
-		return;
+		return false;
 	}
 
 	// StaticMesh から MeshBatch を作成
@@ -468,7 +693,7 @@ void FTinyRenderer::RenderBasePass(FRDGBuilder& GraphBuilder, const FTinySceneTe
 	if (!CreateMeshBatch(MeshBatches, RequiredFeatures))
 	{
 		UE_LOG(LogTinyRenderer, Warning, TEXT("Failed to create mesh batch"));
-		return;
+		return false;
 	}
 
 	// GPUScene のためのパラメータをセットアップ
@@ -492,6 +717,18 @@ void FTinyRenderer::RenderBasePass(FRDGBuilder& GraphBuilder, const FTinySceneTe
 	                                                                  ERenderTargetLoadAction::ELoad,
 	                                                                  FExclusiveDepthStencil::DepthWrite_StencilWrite);
 
+	// マテリアルから ShaderBinding を取得するために、必要に応じて UniformExpression を更新
+	// 複数のセクションが同じマテリアルを共有していることがあるので、マテリアルごとに 1 回だけ行う
+	TArray<const FMaterialRenderProxy*, TInlineAllocator<8>> MaterialRenderProxies;
+	for (const FMeshBatch& MeshBatch : MeshBatches)
+	{
+		MaterialRenderProxies.AddUnique(MeshBatch.MaterialRenderProxy);
+	}
+	for (const FMaterialRenderProxy* MaterialRenderProxy : MaterialRenderProxies)
+	{
+		MaterialRenderProxy->UpdateUniformExpressionCacheIfNeeded(View->GetFeatureLevel());
+	}
+
 	// メッシュ描画用のパスを RDG に登録
 	AddSimpleMeshPass(
 		GraphBuilder, PassParameters, nullptr, *View, nullptr,
@@ -501,11 +738,10 @@ void FTinyRenderer::RenderBasePass(FRDGBuilder& GraphBuilder, const FTinySceneTe
 		{
 			for (const FMeshBatch& MeshBatch : MeshBatches)
 			{
-				// マテリアルから ShaderBinding を取得するために、必要に応じて UniformExpression を更新
-				MeshBatch.MaterialRenderProxy->UpdateUniformExpressionCacheIfNeeded(View->GetFeatureLevel());
 				// MeshBatch を TinyRenderer 用の BasePassMeshProcessor に追加
 				FTinyRendererBasePassMeshProcessor TinyRendererBasePassMeshProcessor(View, DynamicMeshPassContext);
 				TinyRendererBasePassMeshProcessor.AddMeshBatch(MeshBatch, ~0ull, nullptr);
 			}
 		});
+	return true;
 }
@@ -4,12 +4,20 @@
 #include "LegacyScreenPercentageDriver.h"
 #include "RenderGraphBuilder.h"
 #include "RenderGraphEvent.h"
+#include "SceneView.h"
+#include "StaticMeshResources.h"
 #include "TextureResource.h"
 #include "TinyRenderer.h"
+#include "TRMeshBVH.h"
+#include "TinyRendererRenderTargetPool.h"
+#include "Async/Async.h"
 #include "Camera/CameraTypes.h"
+#include "MaterialShared.h"
 #include "Engine/StaticMesh.h"
+#include "Engine/Texture2D.h"
 #include "Engine/TextureRenderTarget2D.h"
 #include "Materials/MaterialInstanceDynamic.h"
+#include "Materials/MaterialInstanceSupport.h"
 
 UTinyRenderer::UTinyRenderer()
 {
@@ -29,11 +37,66 @@ UTinyRenderer* UTinyRenderer::CreateTinyRenderer(UObject* WorldContextObject,
 	return TinyRenderer;
 }
 
+UTinyRenderer* UTinyRenderer::CreatePooledTinyRenderer(UObject* WorldContextObject,
+                                                       UTinyRendererRenderTargetPool* Pool,
+                                                       const FIntPoint& Size,
+                                                       const ETextureRenderTargetFormat Format)
+{
+	if (!WorldContextObject || !Pool || Size.X <= 0 || Size.Y <= 0)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("UTinyRenderer::CreatePooledTinyRenderer: Invalid parameters"));
+		return nullptr;
+	}
+	UTinyRenderer* TinyRenderer = NewObject<UTinyRenderer>(WorldContextObject);
+	TinyRenderer->RenderTargetPool = Pool;
+	TinyRenderer->PooledRenderTargetSize = Size;
+	TinyRenderer->PooledRenderTargetFormat = Format;
+
+	return TinyRenderer;
+}
+
+bool UTinyRenderer::AcquireRenderTarget()
+{
+	if (!RenderTargetPool)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("UTinyRenderer::AcquireRenderTarget: RenderTargetPool is not set"));
+		return false;
+	}
+	/* 既に借りている場合は、その内容がそのまま使える */
+	if (RenderTarget)
+	{
+		return true;
+	}
+
+	bool bImageRetained = false;
+	RenderTarget = RenderTargetPool->Acquire(this, PooledRenderTargetSize, PooledRenderTargetFormat, bImageRetained);
+	/* 他の TinyRenderer が使っていた RenderTarget には、累積した描画結果が残っていない */
+	if (!bImageRetained)
+	{
+		InvalidateAccumulation();
+	}
+	return bImageRetained;
+}
+
+void UTinyRenderer::ReleaseRenderTarget()
+{
+	if (!RenderTargetPool || !RenderTarget)
+	{
+		return;
+	}
+	RenderTargetPool->Release(this, RenderTarget);
+	RenderTarget = nullptr;
+}
+
 void UTinyRenderer::SetStaticMesh(UStaticMesh* InStaticMesh, const int32 InLODIndex)
 {
 	StaticMesh = InStaticMesh;
 	LODIndex = InLODIndex;
 
+	/* 構築済み、または構築中の BVH は以前のメッシュのものなので破棄 */
+	ResetMeshBVH();
+	InvalidateAccumulation();
+
 	OverrideMaterials.Empty();
 	OverrideMaterials.Reserve(StaticMesh->GetStaticMaterials().Num());
 	for (int32 MaterialIndex = 0; MaterialIndex < StaticMesh->GetStaticMaterials().Num(); ++MaterialIndex)
@@ -66,9 +129,10 @@ void UTinyRenderer::SetOverrideMaterial(UMaterialInterface* InMaterial, int32 In
 		OverrideMaterials.AddZeroed(InMaterialIndex - OverrideMaterials.Num() + 1);
 	}
 
-	if (InMaterial)
+	if (InMaterial && OverrideMaterials[InMaterialIndex] != InMaterial)
 	{
 		OverrideMaterials[InMaterialIndex] = InMaterial;
+		InvalidateAccumulation();
 	}
 }
 
@@ -89,20 +153,161 @@ UMaterialInstanceDynamic* UTinyRenderer::CreateAndSetMaterialInstanceDynamic(UMa
 	return MaterialInstance;
 }
 
-void UTinyRenderer::Render()
+void UTinyRenderer::SetScalarParameterValue(const int32 MaterialIndex, const FName ParameterName, const float Value)
 {
-	SCOPED_NAMED_EVENT(UTinyRenderer_Render, FColor::Green);
+	QueueMaterialParameterUpdate(MaterialIndex, ParameterName, FMaterialParameterValue(Value));
+}
 
-	if (!StaticMesh || !RenderTarget)
+void UTinyRenderer::SetVectorParameterValue(const int32 MaterialIndex, const FName ParameterName,
+                                            const FLinearColor& Value)
+{
+	QueueMaterialParameterUpdate(MaterialIndex, ParameterName, FMaterialParameterValue(Value));
+}
+
+void UTinyRenderer::QueueMaterialParameterUpdate(const int32 MaterialIndex, const FName ParameterName,
+                                                 const FMaterialParameterValue& Value)
+{
+	UMaterialInstanceDynamic* MaterialInstance = OverrideMaterials.IsValidIndex(MaterialIndex)
+		                                             ? Cast<UMaterialInstanceDynamic>(OverrideMaterials[MaterialIndex])
+		                                             : nullptr;
+	/* 他のオブジェクトと共有されている MID を書き換えないよう、この TinyRenderer が作成した MID のみを対象にする */
+	if (!MaterialInstance || MaterialInstance->GetOuter() != this)
 	{
-		UE_LOG(LogTemp, Warning, TEXT("UStaticMeshRenderBP::RenderStaticMesh: Invalid parameters"));
+		UE_LOG(LogTemp, Warning, TEXT("UTinyRenderer::QueueMaterialParameterUpdate: Invalid parameters"));
 		return;
 	}
 
-	/* RenderTaget から 描画リソースを取得 */
-	const FTextureRenderTargetResource* RenderTargetResource = RenderTarget->GameThread_GetRenderTargetResource();
+	/* 同じパラメータへの変更が既にあれば、最後の値だけを残す。
+	   毎 Tick 同じ値が設定されても累積描画が収束するよう、値が変わる場合だけ累積をやり直す */
+	if (FTRMaterialParameterUpdate* Pending = PendingMaterialParameterUpdates.FindByPredicate(
+		[MaterialInstance, ParameterName](const FTRMaterialParameterUpdate& Update)
+		{
+			return Update.MaterialInstance == MaterialInstance && Update.ParameterName == ParameterName;
+		}))
+	{
+		if (Pending->Value != Value)
+		{
+			Pending->Value = Value;
+			InvalidateAccumulation();
+		}
+		return;
+	}
 
+	/* 反映済みの値と同じであれば、変更として扱わない */
+	FMaterialParameterMetadata CurrentValue;
+	if (MaterialInstance->GetParameterValue(Value.Type, FMemoryImageMaterialParameterInfo(ParameterName),
+	                                        CurrentValue) && CurrentValue.Value == Value)
+	{
+		return;
+	}
+	PendingMaterialParameterUpdates.Add(FTRMaterialParameterUpdate{MaterialInstance, ParameterName, Value});
+	InvalidateAccumulation();
+}
+
+/**
+ * 蓄積したパラメータ変更を MID の GameThread 側の値に反映し、RenderThread に渡すための変更を返す。
+ * MID の SetXXXParameterValue と異なり、ここでは描画コマンドを発行しない
+ */
+TArray<FTRMaterialParameterRenderUpdate> UTinyRenderer::FlushMaterialParameterUpdates()
+{
+	TArray<FTRMaterialParameterRenderUpdate> RenderUpdates;
+	RenderUpdates.Reserve(PendingMaterialParameterUpdates.Num());
+
+	for (const FTRMaterialParameterUpdate& Update : PendingMaterialParameterUpdates)
+	{
+		UMaterialInstanceDynamic* MaterialInstance = Update.MaterialInstance.Get();
+		if (!MaterialInstance)
+		{
+			continue;
+		}
 
+		const FMaterialParameterInfo ParameterInfo(Update.ParameterName);
+		if (Update.Value.Type == EMaterialParameterType::Scalar)
+		{
+			FScalarParameterValue* ParameterValue = MaterialInstance->ScalarParameterValues.FindByPredicate(
+				[&ParameterInfo](const FScalarParameterValue& InValue)
+				{
+					return InValue.ParameterInfo == ParameterInfo;
+				});
+			if (!ParameterValue)
+			{
+				ParameterValue = &MaterialInstance->ScalarParameterValues.AddDefaulted_GetRef();
+				ParameterValue->ParameterInfo = ParameterInfo;
+			}
+			ParameterValue->ParameterValue = Update.Value.AsScalar();
+		}
+		else
+		{
+			FVectorParameterValue* ParameterValue = MaterialInstance->VectorParameterValues.FindByPredicate(
+				[&ParameterInfo](const FVectorParameterValue& InValue)
+				{
+					return InValue.ParameterInfo == ParameterInfo;
+				});
+			if (!ParameterValue)
+			{
+				ParameterValue = &MaterialInstance->VectorParameterValues.AddDefaulted_GetRef();
+				ParameterValue->ParameterInfo = ParameterInfo;
+			}
+			ParameterValue->ParameterValue = Update.Value.AsLinearColor();
+		}
+
+		RenderUpdates.Add(FTRMaterialParameterRenderUpdate{
+			static_cast<FMaterialInstanceResource*>(MaterialInstance->GetRenderProxy()),
+			FHashedMaterialParameterInfo(ParameterInfo),
+			Update.Value
+		});
+	}
+	PendingMaterialParameterUpdates.Reset();
+
+	return RenderUpdates;
+}
+
+/* 累積描画のジッターに使う Halton 列 */
+static float Halton(int32 Index, const int32 Base)
+{
+	float Result = 0.0f;
+	float Fraction = 1.0f / Base;
+	while (Index > 0)
+	{
+		Result += (Index % Base) * Fraction;
+		Index /= Base;
+		Fraction /= Base;
+	}
+	return Result;
+}
+
+/* 描画コマンドの先頭でパラメータ変更をまとめて反映する。UniformExpression の再計算は BasePass でマテリアルごとに 1 回だけ行われる */
+static void ApplyMaterialParameterUpdates_RenderThread(const TArray<FTRMaterialParameterRenderUpdate>& Updates)
+{
+	for (const FTRMaterialParameterRenderUpdate& Update : Updates)
+	{
+		Update.Resource->RenderThread_UpdateParameter(Update.ParameterInfo, Update.Value);
+	}
+}
+
+/**
+ * 出力全体のうち TileRect の領域だけが画面全体に写るよう、投影後の座標をずらして拡大する行列を計算する
+ * @param OutputSize 出力全体のサイズ
+ * @param TileRect 出力全体における描画対象のタイル領域
+ */
+static FMatrix CalculateTileProjectionOffset(const FIntPoint& OutputSize, const FIntRect& TileRect)
+{
+	const double ScaleX = static_cast<double>(OutputSize.X) / TileRect.Width();
+	const double ScaleY = static_cast<double>(OutputSize.Y) / TileRect.Height();
+	/* タイル中心の NDC 座標。スクリーンの Y は下向き、NDC の Y は上向き */
+	const double CenterX = static_cast<double>(TileRect.Min.X + TileRect.Max.X) / OutputSize.X - 1.0;
+	const double CenterY = 1.0 - static_cast<double>(TileRect.Min.Y + TileRect.Max.Y) / OutputSize.Y;
+
+	return FMatrix(
+		FPlane(ScaleX, 0, 0, 0),
+		FPlane(0, ScaleY, 0, 0),
+		FPlane(0, 0, 1, 0),
+		FPlane(-CenterX * ScaleX, -CenterY * ScaleY, 0, 1));
+}
+
+TUniquePtr<FSceneViewFamilyContext> UTinyRenderer::CreateViewFamily(
+	const FTextureRenderTargetResource* RenderTargetResource) const
+{
 	/* ViewFamily オブジェクトの作成 */
 	FSceneViewFamily::ConstructionValues
 		ConstructionValues(RenderTargetResource, nullptr, FEngineShowFlags(ESFIM_Game));
@@ -113,11 +318,24 @@ void UTinyRenderer::Render()
 	ViewFamily->EngineShowFlags.ScreenPercentage = false;
 	ViewFamily->SetScreenPercentageInterface(new FLegacyScreenPercentageDriver(*ViewFamily, 1.0f));
 
+	return ViewFamily;
+}
+
+/**
+ * @param ViewFamily View を所属させる ViewFamily
+ * @param TileRect RenderTarget 全体のうち描画する領域。RenderTarget 全体を描画する場合は RenderTarget と同じサイズの矩形
+ * @param PixelJitter 投影をずらす量 (ピクセル単位)
+ */
+FSceneViewInitOptions UTinyRenderer::CreateViewInitOptions(FSceneViewFamilyContext* ViewFamily,
+                                                           const FIntRect& TileRect,
+                                                           const FVector2D& PixelJitter) const
+{
 	/* MinimalViewInfo から ViewInitOptions を作成 */
-	const FIntRect ViewRect(0, 0, RenderTarget->SizeX, RenderTarget->SizeY);
+	const FIntRect OutputRect(0, 0, RenderTarget->SizeX, RenderTarget->SizeY);
 	FSceneViewInitOptions ViewInitOptions;
-	ViewInitOptions.SetViewRectangle(ViewRect);
-	ViewInitOptions.ViewFamily = ViewFamily.Get();
+	/* タイルは左上を原点とするタイル用テクスチャに描画されるため、ViewRect はタイルのサイズのみ */
+	ViewInitOptions.SetViewRectangle(FIntRect(FIntPoint::ZeroValue, TileRect.Size()));
+	ViewInitOptions.ViewFamily = ViewFamily;
 	ViewInitOptions.ViewOrigin = ViewInfo.Location;
 	ViewInitOptions.ViewRotationMatrix = FMatrix(
 		{0, 0, 1, 0},
@@ -126,18 +344,83 @@ void UTinyRenderer::Render()
 		{0, 0, 0, 1});
 	ViewInitOptions.FOV = ViewInfo.FOV;
 	ViewInitOptions.DesiredFOV = ViewInfo.FOV;
-	/* 投影行列を計算し、ViewInitOptions に設定 */
+	/* 投影行列を出力全体に対して計算し、ViewInitOptions に設定 */
 	FMinimalViewInfo::CalculateProjectionMatrixGivenViewRectangle(ViewInfo,
 	                                                              AspectRatio_MaintainYFOV,
-	                                                              ViewRect,
+	                                                              OutputRect,
 	                                                              ViewInitOptions);
+	/* タイル描画の場合は、投影行列をタイルの領域に合わせた Off-Center なものに変換 */
+	if (TileRect != OutputRect)
+	{
+		ViewInitOptions.ProjectionMatrix = ViewInitOptions.ProjectionMatrix *
+			CalculateTileProjectionOffset(OutputRect.Size(), TileRect);
+	}
+	/* 投影後の座標を平行移動してサブピクセル単位で投影をずらす。NDC の幅は 2、Y は上向き */
+	if (!PixelJitter.IsZero())
+	{
+		ViewInitOptions.ProjectionMatrix = ViewInitOptions.ProjectionMatrix * FTranslationMatrix(
+			FVector(2.0 * PixelJitter.X / OutputRect.Width(), -2.0 * PixelJitter.Y / OutputRect.Height(), 0.0));
+	}
+
+	return ViewInitOptions;
+}
+
+bool UTinyRenderer::Render()
+{
+	SCOPED_NAMED_EVENT(UTinyRenderer_Render, FColor::Green);
+
+	if (!StaticMesh || !RenderTarget)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("UStaticMeshRenderBP::RenderStaticMesh: Invalid parameters"));
+		return false;
+	}
+
+	/* 準備ができていないまま描画すると RenderTarget が更新されないので、準備ができるまで待ってから描画する */
+	if (!IsReadyToRender())
+	{
+		RenderWhenReady();
+		return false;
+	}
+
+	/* RenderTaget から 描画リソースを取得 */
+	const FTextureRenderTargetResource* RenderTargetResource = RenderTarget->GameThread_GetRenderTargetResource();
+
+	/* 前回の描画以降のマテリアルパラメータの変更を、この描画コマンドでまとめて反映する */
+	TArray<FTRMaterialParameterRenderUpdate> MaterialParameterUpdates = FlushMaterialParameterUpdates();
+
+	if (TileSize > 0 && (RenderTarget->SizeX > TileSize || RenderTarget->SizeY > TileSize))
+	{
+		/* タイル描画では累積を行わないので、次に通常の描画に戻ったときは累積をやり直す */
+		InvalidateAccumulation();
+		RenderTiled(RenderTargetResource, MoveTemp(MaterialParameterUpdates));
+		return true;
+	}
+
+	/* 累積描画では、変化がなければサンプルごとにジッターをずらして描画し、収束したら描画しない */
+	int32 SampleIndex = INDEX_NONE;
+	if (!AdvanceAccumulation(SampleIndex))
+	{
+		return false;
+	}
+	/* 最初のサンプルはジッターなし。以降は Halton 列 (2, 3) で [-0.5, 0.5) の範囲にずらす */
+	const FVector2D PixelJitter = SampleIndex > 0
+		                              ? FVector2D(Halton(SampleIndex, 2) - 0.5f, Halton(SampleIndex, 3) - 0.5f)
+		                              : FVector2D::ZeroVector;
+
+	TUniquePtr<FSceneViewFamilyContext> ViewFamily = CreateViewFamily(RenderTargetResource);
+	const FSceneViewInitOptions ViewInitOptions = CreateViewInitOptions(
+		ViewFamily.Get(), FIntRect(0, 0, RenderTarget->SizeX, RenderTarget->SizeY), PixelJitter);
 
 	ENQUEUE_RENDER_COMMAND(FStaticMeshRenderCommand)(
-		[this, ViewFamily = MoveTemp(ViewFamily), ViewInitOptions](
+		[this, ViewFamily = MoveTemp(ViewFamily), ViewInitOptions,
+			MaterialParameterUpdates = MoveTemp(MaterialParameterUpdates),
+			AccumulationState = AccumulationState, SampleIndex](
 		FRHICommandListImmediate& RHICmdList) mutable
 		{
 			SCOPED_NAMED_EVENT(FStaticMeshRenderCommand_Render, FColor::Green);
 
+			ApplyMaterialParameterUpdates_RenderThread(MaterialParameterUpdates);
+
 			/* TinyRenderer オブジェクトの作成 */
 			FTinyRenderer Renderer(*ViewFamily);
 			/* RenderThread で ViewFamily の初期化を完了 */
@@ -151,10 +434,414 @@ void UTinyRenderer::Render()
 			/* StaticMesh の設定 */
 			Renderer.SetStaticMeshData(StaticMesh, LODIndex, Transform.ToMatrixWithScale(), OverrideMaterials);
 
+			/* 累積描画の設定 */
+			if (AccumulationState)
+			{
+				Renderer.SetAccumulation(AccumulationState.Get(), SampleIndex);
+			}
+
 			/* 作成したレンダラによる描画処理の登録 */
-			Renderer.Render(GraphBuilder);
+			bLastRenderSucceeded_RenderThread = Renderer.Render(GraphBuilder);
 
 			/* RDGBuilder による RHI コマンドの発行と実行 */
 			GraphBuilder.Execute();
 		});
+	return true;
+}
+
+/**
+ * 前回の描画から状態が変わっていなければ次のサンプルへ進め、変わっていれば累積をやり直す
+ * @param OutSampleIndex 今回描画するサンプルの番号。累積描画が無効な場合は INDEX_NONE
+ * @return 描画が必要な場合は true。サンプルが AccumulationSampleCount 枚揃って収束している場合は false
+ */
+bool UTinyRenderer::AdvanceAccumulation(int32& OutSampleIndex)
+{
+	OutSampleIndex = INDEX_NONE;
+	if (AccumulationSampleCount < 2)
+	{
+		ReleaseAccumulationState();
+		return true;
+	}
+
+	if (bAccumulationInvalidated || AccumulatedRenderTarget != RenderTarget ||
+		!Transform.Equals(AccumulatedTransform, 0.0) || !ViewInfo.Equals(AccumulatedViewInfo) ||
+		!(CaptureAccumulationRenderState() == AccumulatedRenderState))
+	{
+		bAccumulationInvalidated = false;
+		AccumulationSampleIndex = 0;
+		AccumulatedTransform = Transform;
+		AccumulatedViewInfo = ViewInfo;
+		AccumulatedRenderTarget = RenderTarget;
+		/* 使われるテクスチャはマテリアルが変わらない限り同じなので、累積を始めるときにだけ集める */
+		AccumulatedTextures = GatherSectionTextures();
+		AccumulatedRenderState = CaptureAccumulationRenderState();
+	}
+	else if (AccumulationSampleIndex >= AccumulationSampleCount)
+	{
+		return false;
+	}
+
+	if (!AccumulationState)
+	{
+		AccumulationState = MakeShared<FTinyRendererAccumulationState, ESPMode::ThreadSafe>();
+	}
+	OutSampleIndex = AccumulationSampleIndex++;
+	return true;
+}
+
+/* IsReadyToRender が true のときに呼び出す */
+UTinyRenderer::FAccumulationRenderState UTinyRenderer::CaptureAccumulationRenderState() const
+{
+	FAccumulationRenderState RenderState;
+	const FStaticMeshRenderData* RenderData = StaticMesh->GetRenderData();
+	RenderState.RenderData = RenderData;
+
+	const int32 LODResourceIndex = FTinyRenderer::GetRenderableLODIndex(*RenderData, LODIndex);
+	for (const FStaticMeshSection& Section : RenderData->LODResources[LODResourceIndex].Sections)
+	{
+		const UMaterialInterface* Material = GetSectionMaterial(Section.MaterialIndex);
+		const FMaterial* MaterialResource = Material ? Material->GetMaterialResource(GMaxRHIFeatureLevel) : nullptr;
+		RenderState.MaterialRenderProxies.Add(Material ? Material->GetRenderProxy() : nullptr);
+		RenderState.MaterialShaderMaps.Add(MaterialResource ? MaterialResource->GetGameThreadShaderMap() : nullptr);
+	}
+
+	for (const TWeakObjectPtr<UTexture2D>& Texture : AccumulatedTextures)
+	{
+		RenderState.TextureResidentMips.Add(Texture.IsValid() ? Texture->GetNumResidentMips() : 0);
+	}
+	return RenderState;
+}
+
+/* 描画する LOD のセクションのマテリアルが使うテクスチャ */
+TArray<TWeakObjectPtr<UTexture2D>> UTinyRenderer::GatherSectionTextures() const
+{
+	const FStaticMeshRenderData* RenderData = StaticMesh->GetRenderData();
+	const int32 LODResourceIndex = FTinyRenderer::GetRenderableLODIndex(*RenderData, LODIndex);
+
+	TArray<UTexture*> UsedTextures;
+	TArray<TWeakObjectPtr<UTexture2D>> Textures;
+	for (const FStaticMeshSection& Section : RenderData->LODResources[LODResourceIndex].Sections)
+	{
+		const UMaterialInterface* Material = GetSectionMaterial(Section.MaterialIndex);
+		if (!Material)
+		{
+			continue;
+		}
+		UsedTextures.Reset();
+		Material->GetUsedTextures(UsedTextures, EMaterialQualityLevel::Num, true, GMaxRHIFeatureLevel, false);
+		for (UTexture* UsedTexture : UsedTextures)
+		{
+			if (UTexture2D* Texture2D = Cast<UTexture2D>(UsedTexture))
+			{
+				Textures.AddUnique(Texture2D);
+			}
+		}
+	}
+	return Textures;
+}
+
+bool UTinyRenderer::IsReadyToRender() const
+{
+	if (!FTinyRenderer::IsStaticMeshReady(StaticMesh, LODIndex))
+	{
+		return false;
+	}
+
+	/* 描画対象の LOD のセクションが使うマテリアルだけを確認する */
+	const FStaticMeshRenderData* RenderData = StaticMesh->GetRenderData();
+	const int32 LODResourceIndex = FTinyRenderer::GetRenderableLODIndex(*RenderData, LODIndex);
+	const ERHIFeatureLevel::Type FeatureLevel = GMaxRHIFeatureLevel;
+	for (const FStaticMeshSection& Section : RenderData->LODResources[LODResourceIndex].Sections)
+	{
+		UMaterialInterface* Material = GetSectionMaterial(Section.MaterialIndex);
+		if (Material && !FTinyRenderer::AreMaterialShadersReady(Material, FeatureLevel))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+bool UTinyRenderer::CanEverBeReadyToRender() const
+{
+	if (!StaticMesh)
+	{
+		return false;
+	}
+	/* コンパイル中は描画データが作り直されるので、まだ判断できない */
+	if (StaticMesh->IsCompiling())
+	{
+		return true;
+	}
+
+	const FStaticMeshRenderData* RenderData = StaticMesh->GetRenderData();
+	const int32 LODResourceIndex = RenderData ? FTinyRenderer::GetRenderableLODIndex(*RenderData, LODIndex) : INDEX_NONE;
+	if (LODResourceIndex == INDEX_NONE)
+	{
+		return false;
+	}
+
+	/* マテリアルのリソースがなければ、シェーダーの有無もコンパイルの完了も判定できない */
+	for (const FStaticMeshSection& Section : RenderData->LODResources[LODResourceIndex].Sections)
+	{
+		const UMaterialInterface* Material = GetSectionMaterial(Section.MaterialIndex);
+		if (Material && !Material->GetMaterialResource(GMaxRHIFeatureLevel))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+/* セクションの描画に使うマテリアル。上書きされていなければ StaticMesh のマテリアル */
+UMaterialInterface* UTinyRenderer::GetSectionMaterial(const int32 MaterialIndex) const
+{
+	UMaterialInterface* OverrideMaterial = OverrideMaterials.IsValidIndex(MaterialIndex)
+		                                       ? OverrideMaterials[MaterialIndex].Get()
+		                                       : nullptr;
+	return OverrideMaterial ? OverrideMaterial : StaticMesh->GetMaterial(MaterialIndex);
+}
+
+void UTinyRenderer::RenderWhenReady()
+{
+	if (!StaticMesh || !RenderTarget)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("UTinyRenderer::RenderWhenReady: Invalid parameters"));
+		return;
+	}
+
+	if (IsReadyToRender())
+	{
+		Render();
+		return;
+	}
+
+	if (!WaitForReadyTickerHandle.IsValid())
+	{
+		WaitForReadyTickerHandle = FTSTicker::GetCoreTicker().AddTicker(
+			FTickerDelegate::CreateUObject(this, &UTinyRenderer::TickWaitForReady));
+	}
+}
+
+bool UTinyRenderer::TickWaitForReady(float DeltaTime)
+{
+	/* false を返すと Ticker から登録解除される */
+	/* 待っている間に RenderTarget を Pool に返却された場合は、描画先がないので待つのをやめる。
+	   再び RenderTarget を借りたときに Render() を呼び直せばよい */
+	if (!StaticMesh || !RenderTarget)
+	{
+		WaitForReadyTickerHandle.Reset();
+		return false;
+	}
+	if (!IsReadyToRender())
+	{
+		/* 準備ができる見込みがなければ、毎フレーム確認し続けないよう待つのをやめる */
+		if (!CanEverBeReadyToRender())
+		{
+			UE_LOG(LogTemp, Warning,
+			       TEXT("UTinyRenderer::TickWaitForReady: %s has no render data or material resource"),
+			       *StaticMesh->GetName());
+			WaitForReadyTickerHandle.Reset();
+			return false;
+		}
+		return true;
+	}
+
+	WaitForReadyTickerHandle.Reset();
+	OnReadyToRender.Broadcast();
+	Render();
+	return false;
+}
+
+void UTinyRenderer::BeginDestroy()
+{
+	if (WaitForReadyTickerHandle.IsValid())
+	{
+		FTSTicker::GetCoreTicker().RemoveTicker(WaitForReadyTickerHandle);
+		WaitForReadyTickerHandle.Reset();
+	}
+	ReleaseAccumulationState();
+	Super::BeginDestroy();
+}
+
+/* 履歴テクスチャは RenderThread で解放する */
+void UTinyRenderer::ReleaseAccumulationState()
+{
+	if (!AccumulationState)
+	{
+		return;
+	}
+	ENQUEUE_RENDER_COMMAND(FTinyRendererReleaseAccumulation)(
+		[AccumulationState = MoveTemp(AccumulationState)](FRHICommandListImmediate&) mutable
+		{
+			AccumulationState.Reset();
+		});
+	AccumulationState.Reset();
+}
+
+void UTinyRenderer::RenderTiled(const FTextureRenderTargetResource* RenderTargetResource,
+                                TArray<FTRMaterialParameterRenderUpdate>&& MaterialParameterUpdates)
+{
+	SCOPED_NAMED_EVENT(UTinyRenderer_RenderTiled, FColor::Green);
+
+	struct FTileView
+	{
+		TUniquePtr<FSceneViewFamilyContext> ViewFamily;
+		FSceneViewInitOptions ViewInitOptions;
+		FIntRect TileRect;
+	};
+
+	/* タイルごとに Off-Center な投影行列を持つ View を作成 */
+	TArray<FTileView> TileViews;
+	for (int32 TileY = 0; TileY < RenderTarget->SizeY; TileY += TileSize)
+	{
+		for (int32 TileX = 0; TileX < RenderTarget->SizeX; TileX += TileSize)
+		{
+			const FIntRect TileRect(TileX, TileY,
+			                        FMath::Min(TileX + TileSize, static_cast<int32>(RenderTarget->SizeX)),
+			                        FMath::Min(TileY + TileSize, static_cast<int32>(RenderTarget->SizeY)));
+			FTileView& TileView = TileViews.AddDefaulted_GetRef();
+			TileView.ViewFamily = CreateViewFamily(RenderTargetResource);
+			TileView.ViewInitOptions = CreateViewInitOptions(TileView.ViewFamily.Get(), TileRect);
+			TileView.TileRect = TileRect;
+		}
+	}
+
+	ENQUEUE_RENDER_COMMAND(FStaticMeshTiledRenderCommand)(
+		[this, TileViews = MoveTemp(TileViews), TileTextureSize = FIntPoint(TileSize, TileSize),
+			MaterialParameterUpdates = MoveTemp(MaterialParameterUpdates)](
+		FRHICommandListImmediate& RHICmdList) mutable
+		{
+			SCOPED_NAMED_EVENT(FStaticMeshTiledRenderCommand_Render, FColor::Green);
+
+			ApplyMaterialParameterUpdates_RenderThread(MaterialParameterUpdates);
+
+			bool bSucceeded = true;
+			for (FTileView& TileView : TileViews)
+			{
+				FTinyRenderer Renderer(*TileView.ViewFamily);
+				GetRendererModule().CreateAndInitSingleView(RHICmdList, TileView.ViewFamily.Get(),
+				                                            &TileView.ViewInitOptions);
+
+				/* タイルごとに RDGBuilder を実行することで、タイル用の SceneColor / SceneDepth が
+				   RenderTargetPool に返却され、次のタイルで再利用される */
+				FRDGBuilder GraphBuilder(RHICmdList,
+				                         RDG_EVENT_NAME("StaticMeshTiledRender"),
+				                         ERDGBuilderFlags::AllowParallelExecute);
+
+				Renderer.SetStaticMeshData(StaticMesh, LODIndex, Transform.ToMatrixWithScale(), OverrideMaterials);
+				Renderer.SetOutputTile(TileView.TileRect, TileTextureSize);
+				bSucceeded &= Renderer.Render(GraphBuilder);
+
+				GraphBuilder.Execute();
+			}
+			bLastRenderSucceeded_RenderThread = bSucceeded;
+		});
+}
+
+void UTinyRenderer::ResetMeshBVH()
+{
+	MeshBVH.Reset();
+	MeshBVHFuture = {};
+	bMeshBVHUnavailable = false;
+	MeshBVHRenderData = nullptr;
+	MeshBVHLODIndex = INDEX_NONE;
+}
+
+ETinyRendererHitTestStatus UTinyRenderer::GetHitTestStatus()
+{
+	/* メッシュが再ビルドされていれば、構築済みの BVH は古い形状のものなので作り直す */
+	if (MeshBVHRenderData &&
+		(!StaticMesh || StaticMesh->GetRenderData() != MeshBVHRenderData || LODIndex != MeshBVHLODIndex))
+	{
+		ResetMeshBVH();
+	}
+
+	if (MeshBVH)
+	{
+		return ETinyRendererHitTestStatus::Ready;
+	}
+	if (bMeshBVHUnavailable)
+	{
+		return ETinyRendererHitTestStatus::Unavailable;
+	}
+
+	/* BVH の構築が完了していれば受け取る */
+	if (MeshBVHFuture.IsValid())
+	{
+		if (!MeshBVHFuture.IsReady())
+		{
+			return ETinyRendererHitTestStatus::NotReady;
+		}
+		MeshBVH = MeshBVHFuture.Get();
+		MeshBVHFuture = {};
+		return ETinyRendererHitTestStatus::Ready;
+	}
+
+	/* 未構築なら、LODResources から必要なデータだけをコピーして、ワーカースレッドで BVH を構築する */
+	if (!FTinyRenderer::IsStaticMeshReady(StaticMesh, LODIndex))
+	{
+		return ETinyRendererHitTestStatus::NotReady;
+	}
+
+	const FStaticMeshRenderData* RenderData = StaticMesh->GetRenderData();
+
+	MeshBVHRenderData = RenderData;
+	MeshBVHLODIndex = LODIndex;
+
+	const int32 LODResourceIndex = FTinyRenderer::GetRenderableLODIndex(*RenderData, LODIndex);
+	FTRMeshBVHSourceData SourceData;
+	if (!SourceData.CopyFrom(RenderData->LODResources[LODResourceIndex]))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("UTinyRenderer::GetHitTestStatus: Mesh data is not accessible from CPU"));
+		bMeshBVHUnavailable = true;
+		return ETinyRendererHitTestStatus::Unavailable;
+	}
+
+	MeshBVHFuture = Async(EAsyncExecution::ThreadPool,
+	                      [SourceData = MoveTemp(SourceData)]() mutable -> TSharedPtr<const FTRMeshBVH>
+	                      {
+		                      return MakeShared<FTRMeshBVH>(MoveTemp(SourceData));
+	                      });
+	return ETinyRendererHitTestStatus::NotReady;
+}
+
+bool UTinyRenderer::HitTest(const FVector2D& ScreenPosition, FTinyRendererHitResult& OutHitResult)
+{
+	SCOPED_NAMED_EVENT(UTinyRenderer_HitTest, FColor::Green);
+
+	if (!StaticMesh || !RenderTarget)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("UTinyRenderer::HitTest: Invalid parameters"));
+		return false;
+	}
+
+	if (GetHitTestStatus() != ETinyRendererHitTestStatus::Ready)
+	{
+		return false;
+	}
+
+	/* Render と同じ View からスクリーン座標をワールド空間のレイに変換 */
+	const FIntRect ViewRect(0, 0, RenderTarget->SizeX, RenderTarget->SizeY);
+	const FSceneViewInitOptions ViewInitOptions = CreateViewInitOptions(nullptr, ViewRect);
+	FVector WorldOrigin;
+	FVector WorldDirection;
+	FSceneView::DeprojectScreenToWorld(ScreenPosition, ViewRect,
+	                                   ViewInitOptions.ComputeViewProjectionMatrix().InverseFast(),
+	                                   WorldOrigin, WorldDirection);
+
+	/* BVH はメッシュのローカル空間で構築されているので、レイをローカル空間に変換 */
+	const FVector LocalOrigin = Transform.InverseTransformPosition(WorldOrigin);
+	const FVector LocalDirection = Transform.InverseTransformVector(WorldDirection);
+
+	FTRMeshBVHHit Hit;
+	if (!MeshBVH->Raycast(FVector3f(LocalOrigin), FVector3f(LocalDirection), Hit))
+	{
+		return false;
+	}
+
+	OutHitResult.SectionIndex = Hit.SectionIndex;
+	OutHitResult.MaterialIndex = Hit.MaterialIndex;
+	OutHitResult.Location = Transform.TransformPosition(LocalOrigin + LocalDirection * Hit.Distance);
+	return true;
 }
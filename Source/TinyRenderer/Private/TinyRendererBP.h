@@ -2,9 +2,51 @@
 
 #include "CoreMinimal.h"
 #include "UObject/Object.h"
+#include "Async/Future.h"
+#include "Engine/TextureRenderTarget2D.h"
+#include "TRMaterialParameterUpdate.h"
+#include "Containers/Ticker.h"
 #include "TinyRendererBP.generated.h"
 
 class UTRPrimitiveReference;
+class FTRMeshBVH;
+class UTinyRendererRenderTargetPool;
+struct FTinyRendererAccumulationState;
+class FSceneViewFamilyContext;
+class FTextureRenderTargetResource;
+struct FSceneViewInitOptions;
+class FStaticMeshRenderData;
+class FMaterialRenderProxy;
+class FMaterialShaderMap;
+class UTexture2D;
+
+USTRUCT(BlueprintType)
+struct FTinyRendererHitResult
+{
+	GENERATED_BODY()
+
+	UPROPERTY(BlueprintReadOnly, Category = "Tiny Renderer")
+	int32 SectionIndex = INDEX_NONE;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Tiny Renderer")
+	int32 MaterialIndex = INDEX_NONE;
+
+	/* ワールド空間でのヒット位置 */
+	UPROPERTY(BlueprintReadOnly, Category = "Tiny Renderer")
+	FVector Location = FVector::ZeroVector;
+};
+
+UENUM(BlueprintType)
+enum class ETinyRendererHitTestStatus : uint8
+{
+	/* メッシュの準備ができていないか、BVH を構築中 */
+	NotReady,
+	Ready,
+	/* メッシュの頂点データに CPU からアクセスできないため、HitTest を利用できない */
+	Unavailable,
+};
+
+DECLARE_DYNAMIC_MULTICAST_DELEGATE(FTinyRendererReadyDelegate);
 
 UCLASS(BlueprintType)
 class UTinyRenderer : public UObject
@@ -19,6 +61,24 @@ public:
 	static UTinyRenderer* CreateTinyRenderer(UObject* WorldContextObject,
 	                                         UTextureRenderTarget2D* RenderTarget);
 
+	/* RenderTarget を Pool から借りる TinyRenderer を作成する。描画前に AcquireRenderTarget を呼ぶ必要がある */
+	UFUNCTION(BlueprintCallable, Category = "Tiny Renderer", meta = (WorldContext = "WorldContextObject"))
+	static UTinyRenderer* CreatePooledTinyRenderer(UObject* WorldContextObject,
+	                                               UTinyRendererRenderTargetPool* Pool,
+	                                               const FIntPoint& Size,
+	                                               ETextureRenderTargetFormat Format = RTF_RGBA8);
+
+	/* Pool から RenderTarget を借りる。前回描画した内容が残っている場合は true を返すので、その場合は再描画を省略できる */
+	UFUNCTION(BlueprintCallable, Category = "Tiny Renderer")
+	bool AcquireRenderTarget();
+
+	/* Pool に RenderTarget を返却する。画面外に出た TinyRenderer から呼び出す */
+	UFUNCTION(BlueprintCallable, Category = "Tiny Renderer")
+	void ReleaseRenderTarget();
+
+	UFUNCTION(BlueprintPure, Category = "Tiny Renderer")
+	UTextureRenderTarget2D* GetRenderTarget() const { return RenderTarget; }
+
 	UFUNCTION(BlueprintCallable, Category = "Static Mesh Renderer")
 	void SetStaticMesh(UStaticMesh* InStaticMesh, const int32 LODIndex);
 
@@ -31,16 +91,114 @@ public:
 	UFUNCTION(BlueprintCallable, Category = "Static Mesh Renderer")
 	UMaterialInstanceDynamic* CreateAndSetMaterialInstanceDynamic(UMaterialInterface* SourceMaterial, const int32 MaterialIndex);
 
+	/* CreateAndSetMaterialInstanceDynamic で作成した MID のパラメータを変更する。
+	   変更は次の Render() まで蓄積され、描画コマンドの中でまとめて反映される */
+	UFUNCTION(BlueprintCallable, Category = "Static Mesh Renderer")
+	void SetScalarParameterValue(const int32 MaterialIndex, const FName ParameterName, const float Value);
+
+	UFUNCTION(BlueprintCallable, Category = "Static Mesh Renderer", meta = (AutoCreateRefTerm = "Value"))
+	void SetVectorParameterValue(const int32 MaterialIndex, const FName ParameterName, const FLinearColor& Value);
+
+	/* 描画を発行する。メッシュやマテリアルの準備ができていない場合は、準備ができた時点で自動的に描画する。
+	   描画コマンドを発行した場合は true、準備を待っている場合や累積描画が収束している場合は false を返す */
+	UFUNCTION(BlueprintCallable, Category = "Static Mesh Renderer")
+	bool Render();
+
+	/* 最後に RenderThread で実行された描画で、メッシュを描画できたかどうか。RenderThread から呼び出す */
+	bool DidLastRenderSucceed_RenderThread() const { return bLastRenderSucceeded_RenderThread; }
+
+	/* メッシュの描画データ、指定 LOD、マテリアルのシェーダーがすべて揃っているかどうか */
+	UFUNCTION(BlueprintPure, Category = "Static Mesh Renderer")
+	bool IsReadyToRender() const;
+
+	/* 待っても IsReadyToRender が true にならないことが確定している場合は false を返す。
+	   メッシュに描画データや LOD がない場合や、マテリアルのリソースがない場合が該当する。読み込み済みのアセットに対して使う */
+	UFUNCTION(BlueprintPure, Category = "Static Mesh Renderer")
+	bool CanEverBeReadyToRender() const;
+
+	/* 準備ができていればすぐに描画し、できていなければ準備ができた時点で描画する */
 	UFUNCTION(BlueprintCallable, Category = "Static Mesh Renderer")
-	void Render();
+	void RenderWhenReady();
+
+	/* RenderWhenReady で待機していた描画の準備ができたときに、描画の直前に呼ばれる */
+	UPROPERTY(BlueprintAssignable, Category = "Static Mesh Renderer")
+	FTinyRendererReadyDelegate OnReadyToRender;
+
+	/* RenderTarget 上のピクセル座標にあるメッシュのセクションを調べる。
+	   GetHitTestStatus が Ready でない間は、ヒットの有無に関わらず false を返す */
+	UFUNCTION(BlueprintCallable, Category = "Static Mesh Renderer")
+	bool HitTest(const FVector2D& ScreenPosition, FTinyRendererHitResult& OutHitResult);
+
+	/* HitTest が利用できるかどうか。BVH が未構築であればバックグラウンドで構築を開始するので、
+	   ホバーの前に呼んでおくと最初の HitTest から結果が得られる */
+	UFUNCTION(BlueprintCallable, Category = "Static Mesh Renderer")
+	ETinyRendererHitTestStatus GetHitTestStatus();
 
 	UPROPERTY(BlueprintReadWrite, Category = "Static Mesh Renderer")
 	FMinimalViewInfo ViewInfo;
 
+	/* 0 より大きい場合、RenderTarget がこのサイズを超えるとタイルに分割して描画する。
+	   SceneDepth などの中間テクスチャがタイルサイズに収まるため、巨大な出力でもメモリ使用量が抑えられる */
+	UPROPERTY(BlueprintReadWrite, Category = "Static Mesh Renderer", meta = (ClampMin = "0"))
+	int32 TileSize = 0;
+
+	/* 2 以上の場合、メッシュ・トランスフォーム・View・マテリアルが変化しない間は、サブピクセルずらした描画を
+	   この枚数まで重ねてアンチエイリアスをかけ、その後は描画を止める。タイル描画時は無効 */
+	UPROPERTY(BlueprintReadWrite, Category = "Static Mesh Renderer", meta = (ClampMin = "0"))
+	int32 AccumulationSampleCount = 0;
+
+	/* 累積描画を最初からやり直す。TinyRenderer が検出できない変化があったときに、収束した描画を更新するために使う */
+	UFUNCTION(BlueprintCallable, Category = "Static Mesh Renderer")
+	void ResetAccumulation() { InvalidateAccumulation(); }
+
+	virtual void BeginDestroy() override;
+
 private:
+	/* 累積を開始したときの描画状態。メッシュの再ビルド、マテリアルの再コンパイル、テクスチャのストリーミングを検出する */
+	struct FAccumulationRenderState
+	{
+		const FStaticMeshRenderData* RenderData = nullptr;
+		/* 描画する LOD のセクションごとのマテリアル */
+		TArray<const FMaterialRenderProxy*> MaterialRenderProxies;
+		TArray<const FMaterialShaderMap*> MaterialShaderMaps;
+		/* AccumulatedTextures のそれぞれの常駐している Mip 数 */
+		TArray<int32> TextureResidentMips;
+
+		bool operator==(const FAccumulationRenderState& Other) const
+		{
+			return RenderData == Other.RenderData && MaterialRenderProxies == Other.MaterialRenderProxies &&
+				MaterialShaderMaps == Other.MaterialShaderMaps && TextureResidentMips == Other.TextureResidentMips;
+		}
+	};
+
+	bool TickWaitForReady(float DeltaTime);
+	UMaterialInterface* GetSectionMaterial(const int32 MaterialIndex) const;
+	void ResetMeshBVH();
+
+	TUniquePtr<FSceneViewFamilyContext> CreateViewFamily(const FTextureRenderTargetResource* RenderTargetResource) const;
+	FSceneViewInitOptions CreateViewInitOptions(FSceneViewFamilyContext* ViewFamily, const FIntRect& TileRect,
+	                                            const FVector2D& PixelJitter = FVector2D::ZeroVector) const;
+	bool AdvanceAccumulation(int32& OutSampleIndex);
+	FAccumulationRenderState CaptureAccumulationRenderState() const;
+	TArray<TWeakObjectPtr<UTexture2D>> GatherSectionTextures() const;
+	void InvalidateAccumulation() { bAccumulationInvalidated = true; }
+	void ReleaseAccumulationState();
+	void RenderTiled(const FTextureRenderTargetResource* RenderTargetResource,
+	                 TArray<FTRMaterialParameterRenderUpdate>&& MaterialParameterUpdates);
+	void QueueMaterialParameterUpdate(const int32 MaterialIndex, const FName ParameterName,
+	                                  const FMaterialParameterValue& Value);
+	TArray<FTRMaterialParameterRenderUpdate> FlushMaterialParameterUpdates();
+
 	UPROPERTY()
 	TObjectPtr<UTextureRenderTarget2D> RenderTarget;
 
+	UPROPERTY()
+	TObjectPtr<UTinyRendererRenderTargetPool> RenderTargetPool;
+
+	FIntPoint PooledRenderTargetSize = FIntPoint::ZeroValue;
+
+	ETextureRenderTargetFormat PooledRenderTargetFormat = RTF_RGBA8;
+
 	UPROPERTY()
 	TObjectPtr<UStaticMesh> StaticMesh;
 
@@ -50,4 +208,33 @@ private:
 
 	UPROPERTY()
 	TArray<TObjectPtr<UMaterialInterface>> OverrideMaterials;
+
+	TArray<FTRMaterialParameterUpdate> PendingMaterialParameterUpdates;
+
+	/* RenderThread でのみ読み書きされる */
+	bool bLastRenderSucceeded_RenderThread = false;
+
+	/* 描画の準備を待っている間だけ登録される Ticker */
+	FTSTicker::FDelegateHandle WaitForReadyTickerHandle;
+
+	/* 累積描画の状態。履歴テクスチャは RenderThread で更新・解放される */
+	TSharedPtr<FTinyRendererAccumulationState, ESPMode::ThreadSafe> AccumulationState;
+	int32 AccumulationSampleIndex = 0;
+	bool bAccumulationInvalidated = true;
+	/* 累積を開始したときの状態。変化があれば累積をやり直す */
+	FTransform AccumulatedTransform;
+	FMinimalViewInfo AccumulatedViewInfo;
+	const UTextureRenderTarget2D* AccumulatedRenderTarget = nullptr;
+	FAccumulationRenderState AccumulatedRenderState;
+	/* 累積を開始したときにマテリアルが使っていたテクスチャ。ストリーミングで Mip が増えたら累積をやり直す */
+	TArray<TWeakObjectPtr<UTexture2D>> AccumulatedTextures;
+
+	/* HitTest 用の BVH。StaticMesh や LOD、メッシュの描画データが変わると破棄される */
+	TSharedPtr<const FTRMeshBVH> MeshBVH;
+	TFuture<TSharedPtr<const FTRMeshBVH>> MeshBVHFuture;
+	/* 頂点データに CPU からアクセスできず、BVH を構築できない */
+	bool bMeshBVHUnavailable = false;
+	/* BVH の構築元。エディタでメッシュが再ビルドされると描画データが作り直されるので、これと比較して検出する */
+	const FStaticMeshRenderData* MeshBVHRenderData = nullptr;
+	int32 MeshBVHLODIndex = INDEX_NONE;
 };
@@ -0,0 +1,167 @@
+#include "TinyRendererRenderTargetPool.h"
+
+#include "TinyRendererBP.h"
+
+UTinyRendererRenderTargetPool* UTinyRendererRenderTargetPool::CreateRenderTargetPool(UObject* WorldContextObject,
+	const int32 InMaxIdleRenderTargets)
+{
+	if (!WorldContextObject)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("UTinyRendererRenderTargetPool::CreateRenderTargetPool: Invalid parameters"));
+		return nullptr;
+	}
+	UTinyRendererRenderTargetPool* Pool = NewObject<UTinyRendererRenderTargetPool>(WorldContextObject);
+	Pool->MaxIdleRenderTargets = FMath::Max(0, InMaxIdleRenderTargets);
+
+	return Pool;
+}
+
+/**
+ * @param Owner RenderTarget を借りる TinyRenderer
+ * @param Size RenderTarget のサイズ
+ * @param Format RenderTarget のフォーマット
+ * @param bOutImageRetained Owner が前回描画した内容が RenderTarget に残っている場合は true
+ * @return 貸し出す RenderTarget
+ */
+UTextureRenderTarget2D* UTinyRendererRenderTargetPool::Acquire(const UTinyRenderer* Owner, const FIntPoint& Size,
+                                                               const ETextureRenderTargetFormat Format,
+                                                               bool& bOutImageRetained)
+{
+	SCOPED_NAMED_EVENT(UTinyRendererRenderTargetPool_Acquire, FColor::Green);
+
+	bOutImageRetained = false;
+	NumAcquires++;
+
+	FTinyRendererPooledRenderTarget* Candidate = nullptr;
+	for (FTinyRendererPooledRenderTarget& Pooled : PooledRenderTargets)
+	{
+		// 返却されないまま TinyRenderer が破棄された場合は、返却済みとして扱う
+		if (Pooled.bLeased && !Pooled.LastOwner.IsValid())
+		{
+			Pooled.bLeased = false;
+		}
+
+		const UTextureRenderTarget2D* RenderTarget = Pooled.RenderTarget;
+		if (Pooled.bLeased || !RenderTarget || RenderTarget->SizeX != Size.X || RenderTarget->SizeY != Size.Y ||
+			RenderTarget->RenderTargetFormat != Format)
+		{
+			continue;
+		}
+
+		// Owner 自身が前回返却したものであれば描画内容が残っているので最優先。それ以外は最も古く使われたものを選ぶ
+		if (Pooled.LastOwner == Owner)
+		{
+			Candidate = &Pooled;
+			bOutImageRetained = true;
+			break;
+		}
+		if (!Candidate || Pooled.LastUsed < Candidate->LastUsed)
+		{
+			Candidate = &Pooled;
+		}
+	}
+
+	if (Candidate)
+	{
+		NumHits++;
+		NumRetainedImageHits += bOutImageRetained ? 1 : 0;
+	}
+	else
+	{
+		UTextureRenderTarget2D* RenderTarget = NewObject<UTextureRenderTarget2D>(this);
+		RenderTarget->RenderTargetFormat = Format;
+		RenderTarget->ClearColor = FLinearColor::Transparent;
+		RenderTarget->InitAutoFormat(Size.X, Size.Y);
+		RenderTarget->UpdateResourceImmediate(true);
+
+		Candidate = &PooledRenderTargets.AddDefaulted_GetRef();
+		Candidate->RenderTarget = RenderTarget;
+	}
+
+	Candidate->LastOwner = Owner;
+	Candidate->bLeased = true;
+	Candidate->LastUsed = ++UseCounter;
+	UTextureRenderTarget2D* RenderTarget = Candidate->RenderTarget;
+
+	TrimIdleRenderTargets(MaxIdleRenderTargets);
+	return RenderTarget;
+}
+
+void UTinyRendererRenderTargetPool::Release(const UTinyRenderer* Owner, UTextureRenderTarget2D* RenderTarget)
+{
+	FTinyRendererPooledRenderTarget* Pooled = PooledRenderTargets.FindByPredicate(
+		[RenderTarget](const FTinyRendererPooledRenderTarget& InPooled)
+		{
+			return InPooled.RenderTarget == RenderTarget;
+		});
+	if (!Pooled || !Pooled->bLeased || Pooled->LastOwner != Owner)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("UTinyRendererRenderTargetPool::Release: RenderTarget is not leased by the owner"));
+		return;
+	}
+
+	Pooled->bLeased = false;
+	Pooled->LastUsed = ++UseCounter;
+
+	TrimIdleRenderTargets(MaxIdleRenderTargets);
+}
+
+void UTinyRendererRenderTargetPool::ReleaseIdleRenderTargets()
+{
+	TrimIdleRenderTargets(0);
+}
+
+FTinyRendererRenderTargetPoolStats UTinyRendererRenderTargetPool::GetStats() const
+{
+	FTinyRendererRenderTargetPoolStats Stats;
+	for (const FTinyRendererPooledRenderTarget& Pooled : PooledRenderTargets)
+	{
+		Stats.NumRenderTargets++;
+		Stats.NumLeasedRenderTargets += Pooled.bLeased && Pooled.LastOwner.IsValid() ? 1 : 0;
+		if (Pooled.RenderTarget)
+		{
+			Stats.MemorySize += static_cast<int64>(Pooled.RenderTarget->CalcTextureMemorySizeEnum(TMC_AllMips));
+		}
+	}
+	Stats.NumAcquires = NumAcquires;
+	Stats.NumHits = NumHits;
+	Stats.NumRetainedImageHits = NumRetainedImageHits;
+	Stats.HitRate = NumAcquires > 0 ? static_cast<float>(NumHits) / NumAcquires : 0.0f;
+
+	return Stats;
+}
+
+/* 返却済みの RenderTarget が MaxIdle 個を超えている場合、最も古く使われたものから解放する */
+void UTinyRendererRenderTargetPool::TrimIdleRenderTargets(const int32 MaxIdle)
+{
+	TArray<int32, TInlineAllocator<64>> IdleIndices;
+	for (int32 PooledIndex = 0; PooledIndex < PooledRenderTargets.Num(); PooledIndex++)
+	{
+		const FTinyRendererPooledRenderTarget& Pooled = PooledRenderTargets[PooledIndex];
+		if (!Pooled.bLeased || !Pooled.LastOwner.IsValid())
+		{
+			IdleIndices.Add(PooledIndex);
+		}
+	}
+	if (IdleIndices.Num() <= MaxIdle)
+	{
+		return;
+	}
+
+	IdleIndices.Sort([this](const int32 A, const int32 B)
+	{
+		return PooledRenderTargets[A].LastUsed < PooledRenderTargets[B].LastUsed;
+	});
+	IdleIndices.SetNum(IdleIndices.Num() - MaxIdle);
+	// 後ろから削除するとインデックスがずれない
+	IdleIndices.Sort(TGreater<int32>());
+	for (const int32 PooledIndex : IdleIndices)
+	{
+		// GC を待たずに GPU リソースを解放する
+		if (UTextureRenderTarget2D* RenderTarget = PooledRenderTargets[PooledIndex].RenderTarget)
+		{
+			RenderTarget->ReleaseResource();
+		}
+		PooledRenderTargets.RemoveAtSwap(PooledIndex);
+	}
+}
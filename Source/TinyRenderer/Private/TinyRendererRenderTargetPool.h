@@ -0,0 +1,99 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/Object.h"
+#include "Engine/TextureRenderTarget2D.h"
+#include "TinyRendererRenderTargetPool.generated.h"
+
+class UTinyRenderer;
+
+USTRUCT(BlueprintType)
+struct FTinyRendererRenderTargetPoolStats
+{
+	GENERATED_BODY()
+
+	/* プールが保持している RenderTarget の数 */
+	UPROPERTY(BlueprintReadOnly, Category = "Tiny Renderer")
+	int32 NumRenderTargets = 0;
+
+	/* TinyRenderer に貸し出し中の RenderTarget の数 */
+	UPROPERTY(BlueprintReadOnly, Category = "Tiny Renderer")
+	int32 NumLeasedRenderTargets = 0;
+
+	/* プールが保持している RenderTarget の合計メモリサイズ (byte) */
+	UPROPERTY(BlueprintReadOnly, Category = "Tiny Renderer")
+	int64 MemorySize = 0;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Tiny Renderer")
+	int32 NumAcquires = 0;
+
+	/* 新規作成せずにプール内の RenderTarget を貸し出せた回数 */
+	UPROPERTY(BlueprintReadOnly, Category = "Tiny Renderer")
+	int32 NumHits = 0;
+
+	/* 前回と同じ RenderTarget を描画済みの内容ごと貸し出せた回数 */
+	UPROPERTY(BlueprintReadOnly, Category = "Tiny Renderer")
+	int32 NumRetainedImageHits = 0;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Tiny Renderer")
+	float HitRate = 0.0f;
+};
+
+USTRUCT()
+struct FTinyRendererPooledRenderTarget
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	TObjectPtr<UTextureRenderTarget2D> RenderTarget;
+
+	/* 最後に貸し出した TinyRenderer。返却後もこの TinyRenderer の描画内容が残っている */
+	TWeakObjectPtr<const UTinyRenderer> LastOwner;
+
+	bool bLeased = false;
+
+	/* LRU のための最終利用順序 */
+	uint64 LastUsed = 0;
+};
+
+/* 多数の TinyRenderer で RenderTarget を共有するためのプール。
+   表示中の TinyRenderer にだけ RenderTarget を貸し出し、返却されたものは最近返却されたものから順に
+   MaxIdleRenderTargets 個まで内容を保持したまま残す */
+UCLASS(BlueprintType)
+class UTinyRendererRenderTargetPool : public UObject
+{
+	GENERATED_BODY()
+
+public:
+	UFUNCTION(BlueprintCallable, Category = "Tiny Renderer", meta = (WorldContext = "WorldContextObject"))
+	static UTinyRendererRenderTargetPool* CreateRenderTargetPool(UObject* WorldContextObject,
+	                                                             const int32 InMaxIdleRenderTargets = 32);
+
+	/* Size と Format が一致する RenderTarget を貸し出す。Owner が前回返却したものが残っていれば、それを優先して返す */
+	UTextureRenderTarget2D* Acquire(const UTinyRenderer* Owner, const FIntPoint& Size,
+	                                ETextureRenderTargetFormat Format, bool& bOutImageRetained);
+	void Release(const UTinyRenderer* Owner, UTextureRenderTarget2D* RenderTarget);
+
+	/* 返却済みの RenderTarget をすべて解放する */
+	UFUNCTION(BlueprintCallable, Category = "Tiny Renderer")
+	void ReleaseIdleRenderTargets();
+
+	UFUNCTION(BlueprintCallable, Category = "Tiny Renderer")
+	FTinyRendererRenderTargetPoolStats GetStats() const;
+
+	/* 貸し出していない状態で保持しておく RenderTarget の最大数 */
+	UPROPERTY(BlueprintReadWrite, Category = "Tiny Renderer", meta = (ClampMin = "0"))
+	int32 MaxIdleRenderTargets = 32;
+
+private:
+	void TrimIdleRenderTargets(int32 MaxIdle);
+
+	UPROPERTY()
+	TArray<FTinyRendererPooledRenderTarget> PooledRenderTargets;
+
+	uint64 UseCounter = 0;
+
+	int32 NumAcquires = 0;
+	int32 NumHits = 0;
+	int32 NumRetainedImageHits = 0;
+};
@@ -0,0 +1,523 @@
+#include "TinyRendererThumbnailCommandlet.h"
+
+#include <atomic>
+
+#include "IImageWrapper.h"
+#include "IImageWrapperModule.h"
+#include "RHIGPUReadback.h"
+#include "RenderingThread.h"
+#include "TextureResource.h"
+#include "TinyRendererBP.h"
+#include "TinyRendererRenderTargetPool.h"
+#include "AssetRegistry/AssetData.h"
+#include "AssetRegistry/AssetRegistryModule.h"
+#include "AssetRegistry/IAssetRegistry.h"
+#include "Engine/StaticMesh.h"
+#include "Misc/FileHelper.h"
+#include "Misc/PackageName.h"
+#include "Misc/Paths.h"
+#include "Misc/SecureHash.h"
+#include "Modules/ModuleManager.h"
+#include "Tasks/Task.h"
+#include "UObject/StrongObjectPtr.h"
+#if WITH_EDITOR
+#include "AssetCompilingManager.h"
+#include "StaticMeshCompiler.h"
+#endif
+
+DEFINE_LOG_CATEGORY_STATIC(LogTinyRendererThumbnail, Log, All);
+
+namespace TinyRendererThumbnail
+{
+	static const TCHAR* ManifestFilename = TEXT("TinyRendererThumbnails.manifest");
+	/* この数のアセットを処理するごとにパイプラインを空にして GC を行い、読み込んだメッシュを解放する */
+	static constexpr int32 GarbageCollectionInterval = 256;
+
+	struct FSettings
+	{
+		TArray<FString> Paths;
+		FString OutputDir;
+		int32 Size = 256;
+		int32 InFlight = 8;
+		float Yaw = 30.0f;
+		float Pitch = -20.0f;
+		float FOV = 30.0f;
+		/* 描画の準備ができるまで待つ最大の秒数 */
+		float ReadyTimeout = 60.0f;
+		bool bRecursive = true;
+		bool bIncremental = false;
+	};
+
+	enum class EJobState : uint8
+	{
+		Loading,
+		Loaded,
+		WaitingReady,
+		WaitingReadback,
+		Encoding,
+		Done,
+		Failed,
+	};
+
+	/* 1 つのアセットのサムネイル生成処理。GameThread / RenderThread / ワーカースレッドで共有される */
+	struct FJob
+	{
+		FAssetData AssetData;
+		FString SourceHash;
+		FString OutputFilename;
+		std::atomic<EJobState> State{EJobState::Loading};
+		double ReadyWaitStartTime = 0.0;
+
+		TStrongObjectPtr<UStaticMesh> StaticMesh;
+		TStrongObjectPtr<UTinyRenderer> Renderer;
+		TUniquePtr<FRHIGPUTextureReadback> Readback;
+	};
+
+	static bool ParseSettings(const FString& Params, FSettings& OutSettings)
+	{
+		FString PathsString;
+		if (!FParse::Value(*Params, TEXT("Paths="), PathsString, false) ||
+			!FParse::Value(*Params, TEXT("OutputDir="), OutSettings.OutputDir))
+		{
+			return false;
+		}
+		PathsString.ParseIntoArray(OutSettings.Paths, TEXT("+"));
+
+		FParse::Value(*Params, TEXT("Size="), OutSettings.Size);
+		FParse::Value(*Params, TEXT("InFlight="), OutSettings.InFlight);
+		FParse::Value(*Params, TEXT("Yaw="), OutSettings.Yaw);
+		FParse::Value(*Params, TEXT("Pitch="), OutSettings.Pitch);
+		FParse::Value(*Params, TEXT("FOV="), OutSettings.FOV);
+		FParse::Value(*Params, TEXT("ReadyTimeout="), OutSettings.ReadyTimeout);
+		OutSettings.bRecursive = !FParse::Param(*Params, TEXT("NonRecursive"));
+		OutSettings.bIncremental = FParse::Param(*Params, TEXT("Incremental"));
+
+		OutSettings.Size = FMath::Max(1, OutSettings.Size);
+		OutSettings.InFlight = FMath::Max(1, OutSettings.InFlight);
+		OutSettings.FOV = FMath::Clamp(OutSettings.FOV, 1.0f, 170.0f);
+		OutSettings.ReadyTimeout = FMath::Max(0.0f, OutSettings.ReadyTimeout);
+		return !OutSettings.Paths.IsEmpty();
+	}
+
+	/**
+	 * メッシュのパッケージと、そこからハード参照をたどったマテリアルやテクスチャなどのパッケージについて、
+	 * アセットレジストリに記録された保存時のハッシュを集め、出力設定を加えたもの。どれかが変わると再生成の対象になる。
+	 * パッケージファイルは読まないので、アセット数が多くても列挙と同程度の時間で済む
+	 * @param SavedHashCache パッケージごとの保存時のハッシュ。マテリアルやテクスチャは多くのメッシュで共有されるので使い回す
+	 * @return メッシュのパッケージがアセットレジストリにない場合は空文字列
+	 */
+	static FString ComputeSourceHash(const IAssetRegistry& AssetRegistry, const FName PackageName,
+	                                 const FSettings& Settings, TMap<FName, TOptional<FIoHash>>& SavedHashCache)
+	{
+		TArray<TPair<FName, FIoHash>> PackageHashes;
+		TSet<FName> VisitedPackages;
+		TArray<FName> PackageStack{PackageName};
+		TArray<FName> Dependencies;
+		while (!PackageStack.IsEmpty())
+		{
+			const FName CurrentPackage = PackageStack.Pop(false);
+			bool bAlreadyVisited = false;
+			VisitedPackages.Add(CurrentPackage, &bAlreadyVisited);
+			/* C++ のクラスは出力設定と同様にバージョンで管理されるので対象外 */
+			if (bAlreadyVisited || FPackageName::IsScriptPackage(CurrentPackage.ToString()))
+			{
+				continue;
+			}
+
+			TOptional<FIoHash>* SavedHash = SavedHashCache.Find(CurrentPackage);
+			if (!SavedHash)
+			{
+				const TOptional<FAssetPackageData> PackageData = AssetRegistry.GetAssetPackageDataCopy(CurrentPackage);
+				SavedHash = &SavedHashCache.Add(CurrentPackage, PackageData.IsSet()
+					                                                ? TOptional<FIoHash>(PackageData->GetPackageSavedHash())
+					                                                : TOptional<FIoHash>());
+			}
+			if (!SavedHash->IsSet())
+			{
+				if (CurrentPackage == PackageName)
+				{
+					return FString();
+				}
+				continue;
+			}
+			PackageHashes.Emplace(CurrentPackage, SavedHash->GetValue());
+
+			Dependencies.Reset();
+			AssetRegistry.GetDependencies(CurrentPackage, Dependencies, UE::AssetRegistry::EDependencyCategory::Package,
+			                              UE::AssetRegistry::EDependencyQuery::Hard);
+			PackageStack.Append(Dependencies);
+		}
+
+		/* たどった順序に依存しないよう、パッケージ名の順に並べてからハッシュを計算する */
+		PackageHashes.Sort([](const TPair<FName, FIoHash>& A, const TPair<FName, FIoHash>& B)
+		{
+			return A.Key.LexicalLess(B.Key);
+		});
+		FString HashSource;
+		for (const TPair<FName, FIoHash>& PackageHash : PackageHashes)
+		{
+			HashSource += PackageHash.Key.ToString() + TEXT(":") + LexToString(PackageHash.Value) + TEXT(";");
+		}
+		return FString::Printf(TEXT("%s_%d_%.2f_%.2f_%.2f"), *FMD5::HashAnsiString(*HashSource),
+		                       Settings.Size, Settings.Yaw, Settings.Pitch, Settings.FOV);
+	}
+
+	static FString GetOutputFilename(const FSettings& Settings, const FAssetData& AssetData)
+	{
+		return Settings.OutputDir / AssetData.PackageName.ToString().RightChop(1) + TEXT(".png");
+	}
+
+	/* マニフェストは 1 行に "PackageName,SourceHash" を記録したテキストファイル */
+	static TMap<FString, FString> LoadManifest(const FString& Filename)
+	{
+		TMap<FString, FString> Manifest;
+		TArray<FString> Lines;
+		FFileHelper::LoadFileToStringArray(Lines, *Filename);
+		for (const FString& Line : Lines)
+		{
+			FString PackageName;
+			FString SourceHash;
+			if (Line.Split(TEXT(","), &PackageName, &SourceHash))
+			{
+				Manifest.Add(MoveTemp(PackageName), MoveTemp(SourceHash));
+			}
+		}
+		return Manifest;
+	}
+
+	static void SaveManifest(const FString& Filename, const TMap<FString, FString>& Manifest)
+	{
+		TArray<FString> Lines;
+		Lines.Reserve(Manifest.Num());
+		for (const TPair<FString, FString>& Entry : Manifest)
+		{
+			Lines.Add(Entry.Key + TEXT(",") + Entry.Value);
+		}
+		Lines.Sort();
+		FFileHelper::SaveStringArrayToFile(Lines, *Filename);
+	}
+
+	/* メッシュ全体が画面に収まるように TinyRenderer を設定する */
+	static void SetupRenderer(const TSharedRef<FJob>& Job, const FSettings& Settings,
+	                          UTinyRendererRenderTargetPool* Pool)
+	{
+		UStaticMesh* Mesh = Job->StaticMesh.Get();
+#if WITH_EDITOR
+		if (Mesh->IsCompiling())
+		{
+			FStaticMeshCompilingManager::Get().FinishCompilation({Mesh});
+		}
+#endif
+
+		UTinyRenderer* Renderer = UTinyRenderer::CreatePooledTinyRenderer(
+			Pool, Pool, FIntPoint(Settings.Size, Settings.Size), RTF_RGBA8_SRGB);
+		Job->Renderer.Reset(Renderer);
+		Renderer->SetStaticMesh(Mesh, 0);
+
+		/* TinyRenderer のカメラは +X 方向を向いているので、メッシュ側を回転させ、バウンディングスフィアが収まる距離にカメラを置く */
+		const FBoxSphereBounds Bounds = Mesh->GetBounds();
+		const FRotator Rotation(Settings.Pitch, Settings.Yaw, 0.0f);
+		Renderer->SetTransform(FTransform(Rotation.Quaternion(), -Rotation.RotateVector(Bounds.Origin)));
+		Renderer->ViewInfo.FOV = Settings.FOV;
+		const double Distance = Bounds.SphereRadius / FMath::Sin(FMath::DegreesToRadians(Settings.FOV * 0.5));
+		Renderer->ViewInfo.Location = FVector(-Distance, 0.0, 0.0);
+
+		Job->ReadyWaitStartTime = FPlatformTime::Seconds();
+		Job->State = EJobState::WaitingReady;
+	}
+
+	/* 描画とリードバックを発行する。Render() が描画を先送りしないよう、IsReadyToRender() を確認してから呼び出す */
+	static void BeginRender(const TSharedRef<FJob>& Job)
+	{
+		UTinyRenderer* Renderer = Job->Renderer.Get();
+		Renderer->AcquireRenderTarget();
+		if (!Renderer->Render())
+		{
+			Renderer->ReleaseRenderTarget();
+			Job->State = EJobState::Failed;
+			return;
+		}
+
+		/* 描画の直後にリードバックのコピーを発行。RenderThread 上で順序が保証されるので、
+		   コピーの発行後は RenderTarget を Pool に返却して次のジョブに使わせてよい */
+		Job->Readback = MakeUnique<FRHIGPUTextureReadback>(TEXT("TinyRendererThumbnailReadback"));
+		const FTextureRenderTargetResource* RenderTargetResource =
+			Renderer->GetRenderTarget()->GameThread_GetRenderTargetResource();
+		/* RenderThread が Failed に変更することがあるので、コマンドの発行前に状態を進めておく */
+		Job->State = EJobState::WaitingReadback;
+		ENQUEUE_RENDER_COMMAND(FTinyRendererThumbnailReadback)(
+			[Job, Renderer, RenderTargetResource](FRHICommandListImmediate& RHICmdList)
+			{
+				/* メッシュを描画できなかった場合、クリアされただけの RenderTarget を出力しないよう失敗として扱う。
+				   Failed にした時点で GameThread が Renderer を解放するので、State の更新は最後に行う */
+				if (!Renderer->DidLastRenderSucceed_RenderThread())
+				{
+					Job->State = EJobState::Failed;
+					return;
+				}
+
+				FRHITexture* Texture = RenderTargetResource->GetRenderTargetTexture();
+				RHICmdList.Transition(FRHITransitionInfo(Texture, ERHIAccess::Unknown, ERHIAccess::CopySrc));
+				Job->Readback->EnqueueCopy(RHICmdList, Texture);
+				RHICmdList.Transition(FRHITransitionInfo(Texture, ERHIAccess::CopySrc, ERHIAccess::SRVMask));
+				RHICmdList.ImmediateFlush(EImmediateFlushType::DispatchToRHIThread);
+			});
+		Renderer->ReleaseRenderTarget();
+	}
+
+	/* PNG エンコードとファイル書き込みをワーカースレッドで行う */
+	static void LaunchEncode(const TSharedRef<FJob>& Job, TArray<FColor>&& Pixels, const int32 Size,
+	                         IImageWrapperModule* ImageWrapperModule)
+	{
+		Job->State = EJobState::Encoding;
+		UE::Tasks::Launch(UE_SOURCE_LOCATION,
+		                  [Job, Pixels = MoveTemp(Pixels), Size, ImageWrapperModule]()
+		                  {
+			                  const TSharedPtr<IImageWrapper> ImageWrapper =
+				                  ImageWrapperModule->CreateImageWrapper(EImageFormat::PNG);
+			                  if (!ImageWrapper || !ImageWrapper->SetRaw(Pixels.GetData(), Pixels.Num() * sizeof(FColor),
+			                                                             Size, Size, ERGBFormat::BGRA, 8))
+			                  {
+				                  Job->State = EJobState::Failed;
+				                  return;
+			                  }
+			                  const TArray64<uint8> Compressed = ImageWrapper->GetCompressed();
+			                  Job->State = FFileHelper::SaveArrayToFile(Compressed, *Job->OutputFilename)
+				                               ? EJobState::Done
+				                               : EJobState::Failed;
+		                  });
+	}
+
+	/* リードバックが完了したジョブのピクセルを読み出してエンコードを開始する。RenderThread で実行 */
+	static void PollReadbacks_RenderThread(const TArray<TSharedRef<FJob>>& Jobs, const int32 Size,
+	                                       IImageWrapperModule* ImageWrapperModule)
+	{
+		for (const TSharedRef<FJob>& Job : Jobs)
+		{
+			/* 描画に失敗したジョブは、リードバックが発行されていない */
+			if (Job->State != EJobState::WaitingReadback || !Job->Readback->IsReady())
+			{
+				continue;
+			}
+
+			int32 RowPitchInPixels = 0;
+			const FColor* Data = static_cast<const FColor*>(Job->Readback->Lock(RowPitchInPixels));
+			TArray<FColor> Pixels;
+			Pixels.SetNumUninitialized(Size * Size);
+			for (int32 Row = 0; Row < Size; Row++)
+			{
+				FMemory::Memcpy(&Pixels[Row * Size], Data + Row * RowPitchInPixels, Size * sizeof(FColor));
+			}
+			Job->Readback->Unlock();
+
+			LaunchEncode(Job, MoveTemp(Pixels), Size, ImageWrapperModule);
+		}
+	}
+}
+
+UTinyRendererThumbnailCommandlet::UTinyRendererThumbnailCommandlet()
+{
+	IsClient = false;
+	IsEditor = true;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+int32 UTinyRendererThumbnailCommandlet::Main(const FString& Params)
+{
+	using namespace TinyRendererThumbnail;
+
+	FSettings Settings;
+	if (!ParseSettings(Params, Settings))
+	{
+		UE_LOG(LogTinyRendererThumbnail, Error,
+		       TEXT("Usage: -run=TinyRendererThumbnail -Paths=/Game/A+/Game/B -OutputDir=<Dir> [-Size=256] "
+			       "[-InFlight=8] [-Yaw=30] [-Pitch=-20] [-FOV=30] [-NonRecursive] [-Incremental] [-ReadyTimeout=60]"));
+		return 1;
+	}
+	if (!IsAllowCommandletRendering())
+	{
+		UE_LOG(LogTinyRendererThumbnail, Error, TEXT("Rendering is disabled. Run with -AllowCommandletRendering"));
+		return 1;
+	}
+
+	/* 対象のアセットを列挙 */
+	IAssetRegistry& AssetRegistry = FModuleManager::LoadModuleChecked<FAssetRegistryModule>(TEXT("AssetRegistry")).Get();
+	AssetRegistry.SearchAllAssets(true);
+
+	FARFilter Filter;
+	Filter.ClassPaths.Add(UStaticMesh::StaticClass()->GetClassPathName());
+	Filter.bRecursivePaths = Settings.bRecursive;
+	for (const FString& Path : Settings.Paths)
+	{
+		Filter.PackagePaths.Add(FName(Path));
+	}
+	TArray<FAssetData> Assets;
+	AssetRegistry.GetAssets(Filter, Assets);
+
+	/* アセットレジストリの情報だけから計算するので、ファイルは読まない */
+	TArray<FString> SourceHashes;
+	SourceHashes.Reserve(Assets.Num());
+	TMap<FName, TOptional<FIoHash>> SavedHashCache;
+	for (const FAssetData& AssetData : Assets)
+	{
+		SourceHashes.Add(ComputeSourceHash(AssetRegistry, AssetData.PackageName, Settings, SavedHashCache));
+	}
+
+	const FString ManifestPath = Settings.OutputDir / ManifestFilename;
+	TMap<FString, FString> Manifest = LoadManifest(ManifestPath);
+
+	/* ジョブは処理を開始するときに作成し、完了したら破棄する */
+	TArray<int32> PendingAssetIndices;
+	for (int32 AssetIndex = 0; AssetIndex < Assets.Num(); AssetIndex++)
+	{
+		const FString PackageName = Assets[AssetIndex].PackageName.ToString();
+		if (Settings.bIncremental && !SourceHashes[AssetIndex].IsEmpty() &&
+			Manifest.FindRef(PackageName) == SourceHashes[AssetIndex] &&
+			FPaths::FileExists(GetOutputFilename(Settings, Assets[AssetIndex])))
+		{
+			continue;
+		}
+		PendingAssetIndices.Add(AssetIndex);
+	}
+	UE_LOG(LogTinyRendererThumbnail, Display, TEXT("%d assets found, %d up to date, %d to render"),
+	       Assets.Num(), Assets.Num() - PendingAssetIndices.Num(), PendingAssetIndices.Num());
+
+	IImageWrapperModule* ImageWrapperModule = &FModuleManager::LoadModuleChecked<IImageWrapperModule>(
+		TEXT("ImageWrapper"));
+	const TStrongObjectPtr<UTinyRendererRenderTargetPool> Pool(
+		UTinyRendererRenderTargetPool::CreateRenderTargetPool(GetTransientPackage(), Settings.InFlight));
+
+	TArray<TSharedRef<FJob>> ActiveJobs;
+	FRenderCommandFence PollFence;
+	int32 NextJobIndex = 0;
+	int32 NumSucceeded = 0;
+	int32 NumFailed = 0;
+	int32 NumSinceGarbageCollection = 0;
+
+	while (NextJobIndex < PendingAssetIndices.Num() || !ActiveJobs.IsEmpty())
+	{
+		/* 読み込みを開始。GC 待ちの間は新しいジョブを開始しない */
+		while (ActiveJobs.Num() < Settings.InFlight && NextJobIndex < PendingAssetIndices.Num() &&
+			NumSinceGarbageCollection < GarbageCollectionInterval)
+		{
+			const int32 AssetIndex = PendingAssetIndices[NextJobIndex++];
+			TSharedRef<FJob> Job = MakeShared<FJob>();
+			Job->AssetData = Assets[AssetIndex];
+			Job->SourceHash = SourceHashes[AssetIndex];
+			Job->OutputFilename = GetOutputFilename(Settings, Assets[AssetIndex]);
+			ActiveJobs.Add(Job);
+			NumSinceGarbageCollection++;
+			LoadPackageAsync(Job->AssetData.PackageName.ToString(), FLoadPackageAsyncDelegate::CreateLambda(
+				                 [Job](const FName&, UPackage*, EAsyncLoadingResult::Type Result)
+				                 {
+					                 UStaticMesh* Mesh = Result == EAsyncLoadingResult::Succeeded
+						                                     ? Cast<UStaticMesh>(Job->AssetData.GetAsset())
+						                                     : nullptr;
+					                 Job->StaticMesh.Reset(Mesh);
+					                 Job->State = Mesh ? EJobState::Loaded : EJobState::Failed;
+				                 }));
+		}
+
+		/* 読み込みが完了したものから描画 */
+		TArray<TSharedRef<FJob>> ReadbackJobs;
+		for (const TSharedRef<FJob>& Job : ActiveJobs)
+		{
+			if (Job->State == EJobState::Loaded)
+			{
+				SetupRenderer(Job, Settings, Pool.Get());
+			}
+			/* シェーダーのコンパイルやメッシュのストリーミングが終わったものから描画。
+			   壊れたアセットでコマンドレット全体が止まらないよう、準備ができる見込みがないものと時間切れのものは失敗にする */
+			if (Job->State == EJobState::WaitingReady)
+			{
+				const UTinyRenderer* Renderer = Job->Renderer.Get();
+				if (Renderer->IsReadyToRender())
+				{
+					BeginRender(Job);
+				}
+				else if (!Renderer->CanEverBeReadyToRender())
+				{
+					UE_LOG(LogTinyRendererThumbnail, Warning, TEXT("Mesh has no render data or material resource: %s"),
+					       *Job->AssetData.PackageName.ToString());
+					Job->State = EJobState::Failed;
+				}
+				else if (FPlatformTime::Seconds() - Job->ReadyWaitStartTime > Settings.ReadyTimeout)
+				{
+					UE_LOG(LogTinyRendererThumbnail, Warning, TEXT("Timed out waiting for render readiness: %s"),
+					       *Job->AssetData.PackageName.ToString());
+					Job->State = EJobState::Failed;
+				}
+			}
+			if (Job->State == EJobState::WaitingReadback)
+			{
+				ReadbackJobs.Add(Job);
+			}
+		}
+
+		/* 前回のポーリングが終わっていれば、リードバックの完了を RenderThread で確認 */
+		if (!ReadbackJobs.IsEmpty() && PollFence.IsFenceComplete())
+		{
+			ENQUEUE_RENDER_COMMAND(FTinyRendererThumbnailPoll)(
+				[ReadbackJobs = MoveTemp(ReadbackJobs), Size = Settings.Size, ImageWrapperModule](
+				FRHICommandListImmediate&)
+				{
+					PollReadbacks_RenderThread(ReadbackJobs, Size, ImageWrapperModule);
+				});
+			PollFence.BeginFence();
+		}
+
+		/* 完了したジョブを回収 */
+		for (int32 JobIndex = ActiveJobs.Num() - 1; JobIndex >= 0; JobIndex--)
+		{
+			const TSharedRef<FJob>& Job = ActiveJobs[JobIndex];
+			const EJobState State = Job->State;
+			if (State != EJobState::Done && State != EJobState::Failed)
+			{
+				continue;
+			}
+
+			const FString PackageName = Job->AssetData.PackageName.ToString();
+			if (State == EJobState::Done)
+			{
+				NumSucceeded++;
+				Manifest.Add(PackageName, Job->SourceHash);
+			}
+			else
+			{
+				NumFailed++;
+				UE_LOG(LogTinyRendererThumbnail, Warning, TEXT("Failed to render thumbnail: %s"), *PackageName);
+			}
+
+			/* エンコードタスクや RenderThread のコマンドが FJob を最後に手放すことがあるので、強参照はここで
+			   GameThread から手放す。これで次の GC でメッシュ・TinyRenderer・リードバック用のテクスチャが解放される */
+			Job->Readback.Reset();
+			Job->Renderer.Reset();
+			Job->StaticMesh.Reset();
+			ActiveJobs.RemoveAtSwap(JobIndex);
+		}
+
+		/* パイプラインが空になったら GC で読み込んだメッシュを解放し、途中経過のマニフェストを保存 */
+		if (ActiveJobs.IsEmpty() && NumSinceGarbageCollection >= GarbageCollectionInterval)
+		{
+			UE_LOG(LogTinyRendererThumbnail, Display, TEXT("%d / %d"), NextJobIndex, PendingAssetIndices.Num());
+			SaveManifest(ManifestPath, Manifest);
+			CollectGarbage(RF_NoFlags);
+			NumSinceGarbageCollection = 0;
+		}
+
+		/* 非同期読み込みとアセットのコンパイルを進める */
+		ProcessAsyncLoading(true, false, 0.005);
+#if WITH_EDITOR
+		FAssetCompilingManager::Get().ProcessAsyncTasks();
+#endif
+		FTaskGraphInterface::Get().ProcessThreadUntilIdle(ENamedThreads::GameThread);
+		FPlatformProcess::Sleep(0.0f);
+	}
+
+	FlushRenderingCommands();
+	SaveManifest(ManifestPath, Manifest);
+	UE_LOG(LogTinyRendererThumbnail, Display, TEXT("Rendered %d thumbnails, %d failed"), NumSucceeded, NumFailed);
+
+	return NumFailed > 0 ? 1 : 0;
+}
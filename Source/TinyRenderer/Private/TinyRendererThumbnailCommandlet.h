@@ -0,0 +1,28 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "TinyRendererThumbnailCommandlet.generated.h"
+
+/**
+ * StaticMesh のサムネイルを TinyRenderer で一括生成するコマンドレット。
+ * 読み込み・描画・リードバック・PNG エンコードをパイプライン化し、最大 InFlight 個のメッシュを同時に処理する。
+ *
+ * UnrealEditor-Cmd <Project> -run=TinyRendererThumbnail -AllowCommandletRendering
+ *     -Paths=/Game/Meshes+/Game/Props -OutputDir=<Dir> [-Size=256] [-InFlight=8] [-Yaw=30] [-Pitch=-20]
+ *     [-NonRecursive] [-Incremental] [-ReadyTimeout=60]
+ *
+ * -Incremental を指定すると、メッシュと参照先のマテリアル・テクスチャなどのパッケージのハッシュと、
+ * 出力設定が前回と同じアセットをスキップする。
+ * -ReadyTimeout 秒を過ぎてもシェーダーなどの準備ができないアセットは失敗として扱う。
+ */
+UCLASS()
+class UTinyRendererThumbnailCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UTinyRendererThumbnailCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};
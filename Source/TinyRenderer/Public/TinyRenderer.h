@@ -3,6 +3,15 @@
 #include "Runtime/Renderer/Private/SceneUniformBuffer.h"
 
 struct FTRRenderingMeshData;
+class FStaticMeshRenderData;
+
+// プログレッシブな累積描画の状態。UTinyRenderer がフレームをまたいで保持し、RenderThread でのみ更新される
+struct FTinyRendererAccumulationState
+{
+	TRefCountPtr<IPooledRenderTarget> HistoryTexture;
+	// HistoryTexture に平均されているサンプルの数。描画に失敗したサンプルは含まない
+	int32 NumAccumulatedSamples = 0;
+};
 
 class TINYRENDERER_API FTinyRenderer
 {
@@ -12,12 +21,24 @@ public:
 	// StaticMesh およびその変換行列を設定する
 	void SetStaticMeshData(UStaticMesh* InStaticMesh, const int32 InLODIndex, const FMatrix& InLocalToWorld,
 	                       const TArray<UMaterialInterface*>& InOverrideMaterials);
-	// 描画命令を発行する
-	void Render(FRDGBuilder& GraphBuilder);
+	// タイル描画を行う場合に、出力先 RenderTarget 上で描画するタイルの領域と、タイル用テクスチャのサイズを設定する
+	void SetOutputTile(const FIntRect& InTileRect, const FIntPoint& InTileTextureSize);
+	// 累積描画を行う場合に、累積の状態と今回のサンプル番号を設定する。サンプル番号が 0 の場合は累積をリセットする
+	void SetAccumulation(FTinyRendererAccumulationState* InAccumulationState, const int32 InSampleIndex);
+	// 描画命令を発行する。BasePass を描画できなかった場合は false を返す
+	bool Render(FRDGBuilder& GraphBuilder);
+
+	// StaticMesh の描画データが利用可能かどうかを判定する。GameThread から呼び出す
+	static bool IsStaticMeshReady(const UStaticMesh* InStaticMesh, const int32 InLODIndex);
+	// 指定 LOD の代わりに実際に描画する LOD。常駐している LOD の範囲に収める。常駐している LOD がない場合は INDEX_NONE
+	static int32 GetRenderableLODIndex(const FStaticMeshRenderData& InRenderData, const int32 InLODIndex);
+	// マテリアルの TinyRenderer 用シェーダーのコンパイルが完了しているかどうかを判定する。GameThread から呼び出す
+	static bool AreMaterialShadersReady(UMaterialInterface* InMaterial, const ERHIFeatureLevel::Type InFeatureLevel);
 
 private:
 	struct FTinySceneTextures
 	{
+		FRDGTextureRef OutputTexture;
 		FRDGTextureRef SceneColorTexture;
 		FRDGTextureRef SceneDepthTexture;
 	};
@@ -28,7 +49,9 @@ private:
 	};
 
 	FTinySceneTextures SetupSceneTextures(FRDGBuilder& GraphBuilder) const;
-	void RenderBasePass(FRDGBuilder& GraphBuilder, const FTinySceneTextures& SceneTextures);
+	bool RenderBasePass(FRDGBuilder& GraphBuilder, const FTinySceneTextures& SceneTextures);
+	void CopyTileToOutput(FRDGBuilder& GraphBuilder, const FTinySceneTextures& SceneTextures) const;
+	void AccumulateToOutput(FRDGBuilder& GraphBuilder, const FTinySceneTextures& SceneTextures) const;
 
 	bool CreateMeshBatch(TArray<FMeshBatch>& OutMeshBatches,
 	                     FMeshBatchesRequiredFeatures& OutRequiredFeatures) const;
@@ -47,4 +70,10 @@ private:
 	FMatrix LocalToWorld;
 	int32 LODIndex;
 	TArray<TWeakObjectPtr<UMaterialInterface>> OverrideMaterials;
+
+	TOptional<FIntRect> OutputTileRect;
+	FIntPoint TileTextureSize = FIntPoint::ZeroValue;
+
+	FTinyRendererAccumulationState* AccumulationState = nullptr;
+	int32 AccumulationSampleIndex = 0;
 };
@@ -10,6 +10,7 @@ public class TinyRenderer : ModuleRules
 			new string[]
 			{
 				System.IO.Path.Combine(GetModuleDirectory("Renderer"), "Private"),
+				System.IO.Path.Combine(GetModuleDirectory("Engine"), "Private"),
 			}
 		);
 
@@ -32,6 +33,8 @@ public class TinyRenderer : ModuleRules
 				"RenderCore",
 				"Renderer",
 				"Projects",
+				"AssetRegistry",
+				"ImageWrapper",
 			}
 		);
 	}